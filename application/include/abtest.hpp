@@ -0,0 +1,48 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef ABTEST_HPP_INCLUDED
+#define ABTEST_HPP_INCLUDED
+
+#include <string>
+
+/* ABConfig names the two variants of each model to compare, typically an FP32 IR as A and an
+   FP16 or INT8 IR of the same model as B, and the accuracy limits B must stay within.*/
+struct ABConfig
+{
+    std::string faceA;
+    std::string faceB;
+    std::string poseA;
+    std::string poseB;
+    std::string device;
+    int maxFrames;
+    bool nv12;
+    double minIou;            // mean IoU of matched face boxes
+    double minCountAgreement; // fraction of frames with the same shopper and looker counts
+    double maxAngleError;     // mean yaw and pitch error in degrees
+};
+
+ABConfig defaultABConfig();
+int runPrecisionAB(const std::string &input, const ABConfig &config);
+
+#endif
@@ -0,0 +1,72 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef BUDGET_HPP_INCLUDED
+#define BUDGET_HPP_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include <opencv2/core.hpp>
+#include "tracker.hpp"
+
+// BudgetStats counts how head pose work fit in the per-frame latency budget.
+struct BudgetStats
+{
+    uint64_t frames;
+    uint64_t overruns;    // frames that took longer than the budget
+    uint64_t poseRun;     // faces that got head pose inference
+    uint64_t poseSkipped; // faces left without head pose inference to stay in budget
+    uint64_t carried;     // skipped faces that kept the last known state of their track
+    uint64_t unknown;     // skipped faces whose track had no state yet
+    double worstMs;       // slowest frame
+};
+
+/* PoseBudget schedules head pose inference within a per-frame latency budget. Faces are served
+   in priority order and a pose batch is only started while its estimated cost still fits, so
+   frame latency stays bounded however many faces are in view. The counters are atomic because
+   load generator workers share one budget.*/
+class PoseBudget
+{
+public:
+    PoseBudget();
+    void configure(double budgetMs);
+    bool isEnabled() const;
+    double budgetMs() const;
+    std::vector<size_t> order(const std::vector<cv::Rect> &faces, const std::vector<int> &trackIndex,
+                              const std::vector<Track> &tracks, int64_t nowMs) const;
+    bool fits(double elapsedMs, double batchCostMs) const;
+    void recordFrame(double elapsedMs, size_t run, size_t skipped, size_t carried);
+    BudgetStats getStats() const;
+
+private:
+    double limitMs;
+    std::atomic<uint64_t> frames;
+    std::atomic<uint64_t> overruns;
+    std::atomic<uint64_t> poseRun;
+    std::atomic<uint64_t> poseSkipped;
+    std::atomic<uint64_t> carried;
+    std::atomic<uint64_t> worstUs;
+};
+
+#endif
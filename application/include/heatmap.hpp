@@ -0,0 +1,65 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef HEATMAP_HPP_INCLUDED
+#define HEATMAP_HPP_INCLUDED
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// HeatmapConfig describes the shelf grid of one camera.
+struct HeatmapConfig
+{
+    int cols;
+    int rows;
+    double distance; // distance from shopper to shelf, relative to the width of the frame
+    double halfLife; // seconds after which a gaze sample counts half
+    int interval;    // seconds between published snapshots
+};
+
+/* GazeHeatmap accumulates where on the shelf shoppers look. Each cell keeps a fixed-point
+   weight and the tick of its last update, and decay is applied lazily when a cell is hit or
+   read, so adding a sample is O(1) and nothing is rescanned or reallocated per frame.*/
+class GazeHeatmap
+{
+public:
+    GazeHeatmap();
+    bool configure(const HeatmapConfig &config);
+    bool isEnabled() const;
+    int interval() const;
+    void addGaze(float faceX, float faceY, float yawDeg, float pitchDeg, int64_t nowMs);
+    std::string snapshot(int64_t nowMs);
+
+private:
+    uint32_t decayed(size_t cell, uint32_t tick) const;
+
+    HeatmapConfig config;
+    std::vector<uint32_t> weight;   // Q8 fixed point, 256 is one fresh gaze sample
+    std::vector<uint32_t> lastTick; // tick of the last update of each cell
+    std::vector<uint32_t> decay;    // Q16 decay factor for each number of elapsed ticks
+    std::mutex lock;
+};
+
+#endif
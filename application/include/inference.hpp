@@ -36,15 +36,19 @@ class Network
   size_t modelHeight;
   size_t modelChannels;
   size_t conf_batchSize;
+  size_t conf_inputWidth;
+  size_t conf_inputHeight;
 
 public:
   int maxProposalCount;
   InferenceEngine::Core ie;
-  InferenceEngine::InputsDataMap *inputInfo;
+  InferenceEngine::InputsDataMap inputInfo;
   int channelSize;
   int inputSize;
   int isAsync;
+  bool nv12Input;
   std::string outputName;
+  std::vector<std::string> outputNames;
   int objectSize;
   InferenceEngine::InferRequest::Ptr currInfReq;
   InferenceEngine::InferRequest::Ptr nextInfReq;
@@ -52,16 +56,26 @@ public:
   InferenceEngine::SizeVector outputDims;
 //  InferenceEngine::CNNNetReader networkReader;
   InferenceEngine::ExecutableNetwork network;
-  const std::string *inputName = NULL;
+  std::string inputName;
+  cv::Mat currInput;
+  cv::Mat nextInput;
   Network();
-  int loadNetwork(std::string conf_modelLayers, std::string conf_modelWeights, InferenceEngine::Core ie, std::string myTargetDevice);
+  int loadNetwork(std::string conf_modelLayers, std::string conf_modelWeights, InferenceEngine::Core &ie, std::string myTargetDevice);
   template <typename T>
   void cvMatToBlob(const cv::Mat &img, InferenceEngine::Blob::Ptr &blob);
+  void setInputSize(size_t width, size_t height);
+  void setBatchSize(size_t batchSize);
+  size_t getBatchSize();
   size_t getModelHeight();
   size_t getModelWidth();
-  void fillInputBlob(cv::Mat img);
+  void fillInputBlob(const cv::Mat &img);
+  void fillInputBlobNV12(const cv::Mat &nv12);
+  void fillInputSlot(const cv::Mat &img, const cv::Rect &roi, size_t slot);
   void inferenceRequest();
   void swapInferenceRequest();
   float *inference();
+  float *inference(const std::string &name);
   void *wait();
 };
+
+void parseFaces(Network &net, cv::Size size, std::vector<cv::Rect> &faces);
@@ -0,0 +1,81 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef LOADGEN_HPP_INCLUDED
+#define LOADGEN_HPP_INCLUDED
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+// LoadGenConfig describes the virtual camera streams simulated by the load generator.
+struct LoadGenConfig
+{
+    int streams;        // fixed stream count used by benchmarks
+    int maxStreams;     // upper bound for the stream count search
+    int maxFrames;      // number of frames decoded into the frame cache
+    int duration;       // seconds each stream count is measured for
+    double fps;         // frame rate of each virtual stream, 0 uses the clip frame rate
+    double offsetMs;    // start offset between consecutive streams, <0 spreads them over one frame period
+    double jitterMs;    // maximum random deviation of each frame arrival time
+    double targetP99Ms; // p99 latency a stream count must meet to be sustainable
+};
+
+// LoadGenResult contains the statistics measured for one stream count.
+struct LoadGenResult
+{
+    int streams;
+    long frames;
+    long dropped;
+    double throughput;
+    double p50Ms;
+    double p99Ms;
+    double jitterMs;    // standard deviation of the latency
+    bool sustainable;
+};
+
+// FrameCache holds a clip decoded once so it can be replayed without touching the decoder again.
+class FrameCache
+{
+public:
+    std::vector<cv::Mat> frames;
+    double fps;
+    FrameCache();
+    bool load(const std::string &input, int maxFrames, bool nv12);
+};
+
+/* FrameProcessor runs the full analytics pipeline on one frame of a virtual stream. Each worker thread
+   owns one, and every frame of a stream goes to the same worker, in order.*/
+typedef std::function<void(const cv::Mat &, int stream)> FrameProcessor;
+
+// WorkerInit is called on each worker thread before it processes frames, for example to pin it.
+typedef std::function<void(size_t worker)> WorkerInit;
+
+LoadGenConfig defaultLoadGenConfig();
+LoadGenResult runLoadStep(const FrameCache &cache, const LoadGenConfig &config, int streams, std::vector<FrameProcessor> &workers,
+                          WorkerInit init = WorkerInit());
+int runLoadGen(const FrameCache &cache, const LoadGenConfig &config, std::vector<FrameProcessor> &workers);
+void printLoadStep(const LoadGenResult &r);
+
+#endif
@@ -57,9 +57,11 @@ std::string std_getenv(const std::string &name);
 std::pair<mqtt_service_config, bool> get_mqtt_config();
 int mqtt_start(MQTTClient_messageArrived *msgrcv);
 void mqtt_close();
-void mqtt_connect();
+int mqtt_connect();
+bool mqtt_is_connected();
 void mqtt_disconnect();
 int mqtt_publish(std::string const &topic, std::string const &message);
+size_t mqtt_publish_batch(std::vector<std::pair<std::string, std::string> > const &messages);
 void mqtt_subscribe(std::string const &topic);
 
 #endif
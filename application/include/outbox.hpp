@@ -0,0 +1,104 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef OUTBOX_HPP_INCLUDED
+#define OUTBOX_HPP_INCLUDED
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// OutboxMessage is one pending MQTT message: a topic and its payload.
+typedef std::pair<std::string, std::string> OutboxMessage;
+
+// OutboxPublisher publishes a batch of messages in order and returns how many of them were delivered.
+typedef std::function<size_t(const std::vector<OutboxMessage> &)> OutboxPublisher;
+
+// OutboxReconnect tries to re-establish the broker connection and returns true when connected.
+typedef std::function<bool()> OutboxReconnect;
+
+// OutboxStats contains the metrics exposed by the outbox.
+struct OutboxStats
+{
+    uint64_t pending;       // messages waiting to be published
+    uint64_t pendingBytes;  // ring bytes used by the pending messages
+    uint64_t dropped;       // oldest messages discarded because the ring was full
+    uint64_t replayed;      // messages delivered by the drain thread since start
+    double replayRate;      // messages per second delivered during the last second
+};
+
+/* Outbox is a disk-backed ring of pending MQTT messages kept in a memory-mapped file.
+   push only copies into the mapping, a drain thread publishes batches while the broker
+   is reachable and a flusher thread writes dirty pages back to disk, so neither the
+   producer nor the publisher waits for disk I/O. The ring indexes are double-buffered
+   and every record carries a CRC, so a crash loses at most the records written since
+   the last flush.*/
+class Outbox
+{
+public:
+    Outbox();
+    ~Outbox();
+    bool open(const std::string &path, size_t capacity);
+    bool isOpen() const;
+    void push(const std::string &topic, const std::string &payload);
+    void start(OutboxPublisher publisher, OutboxReconnect reconnect);
+    void stop();
+    OutboxStats getStats();
+
+private:
+    void writeIndex();
+    bool readRecord(uint64_t pos, OutboxMessage *msg, uint64_t *next) const;
+    uint64_t nextRecord(uint64_t pos) const;
+    void recover();
+    void drainRunner();
+    void flushRunner();
+
+    int fd;
+    uint8_t *base;
+    uint8_t *ring;
+    uint64_t capacity;
+    uint64_t head;
+    uint64_t tail;
+    uint64_t generation;
+    uint64_t pending;
+    uint64_t dropped;
+    uint64_t replayed;
+    double replayRate;
+    bool dirty;
+
+    std::mutex lock;
+    std::condition_variable available;
+    std::atomic<bool> running;
+    std::thread drainThread;
+    std::thread flushThread;
+    OutboxPublisher publisher;
+    OutboxReconnect reconnect;
+};
+
+#endif
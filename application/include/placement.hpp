@@ -0,0 +1,46 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef PLACEMENT_HPP_INCLUDED
+#define PLACEMENT_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+
+// PlacementConfig lists the CPUs each group of threads may run on. An empty list leaves the group unpinned.
+struct PlacementConfig
+{
+    std::vector<int> capture;   // video capture and decode, the main thread
+    std::vector<int> inference; // pre-processing and inference
+    std::vector<int> messaging; // MQTT publishing, outbox and telemetry
+    std::string pluginBind;     // CPU plugin thread binding: YES, NUMA or NO
+    int pluginThreads;          // CPU plugin thread count, 0 for the plugin default
+};
+
+bool parseCpuSet(const std::string &spec, std::vector<int> &cpus);
+int numaNodeOfCpu(int cpu);
+bool pinCurrentThread(const std::vector<int> &cpus);
+std::vector<int> currentThreadCpus();
+std::string describeCpuSet(const std::vector<int> &cpus);
+
+#endif
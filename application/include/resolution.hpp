@@ -0,0 +1,55 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef RESOLUTION_HPP_INCLUDED
+#define RESOLUTION_HPP_INCLUDED
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <opencv2/core.hpp>
+
+bool parseResolution(const std::string &text, cv::Size &size);
+
+/* ResolutionSelector picks the face detector input resolution for a stream from the face sizes
+   it sees. It runs the smallest resolution at which the smallest recent faces are still at least
+   minFacePx high in the network input. Every probeInterval frames it runs the largest resolution,
+   so that faces too small for the current one are noticed.*/
+class ResolutionSelector
+{
+public:
+    ResolutionSelector();
+    void configure(const std::vector<cv::Size> &sizes, int minFacePx, int probeInterval);
+    bool isEnabled() const;
+    size_t choose(uint64_t frame);
+    void observe(const std::vector<cv::Rect> &faces, int frameHeight, size_t chosen);
+
+private:
+    std::vector<cv::Size> sizes; // ascending height
+    int minFacePx;
+    int probeInterval;
+    double smallFace; // height of the small faces relative to the frame, 0 before any face is seen
+    size_t selected;
+};
+
+#endif
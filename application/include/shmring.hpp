@@ -0,0 +1,119 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef SHMRING_HPP_INCLUDED
+#define SHMRING_HPP_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <opencv2/core/core.hpp>
+
+/* A shared-memory frame ring lets an external decoder process, such as an NVR, hand decoded
+   frames to the monitor without copies. The producer creates a POSIX shared memory object
+   holding a ShmRingHeader followed by slots page aligned slots, each a ShmSlotHeader followed by
+   one frame. It writes frame seq into slot seq % slots, publishes it by storing head and wakes
+   the consumer through a futex on the wake word. The consumer maps the frame it reads straight
+   into a cv::Mat header and stores in released the newest sequence number it is done with. The
+   producer never blocks: while a consumer is attached, a frame that would overwrite a slot still
+   in use is dropped instead. A consumer that has not updated its heartbeat for
+   SHM_RING_STALE_MS is treated as gone.*/
+
+#define SHM_RING_MAGIC 0x52475347 // "SGGR"
+#define SHM_RING_VERSION 1
+#define SHM_RING_STALE_MS 2000
+
+enum ShmFrameFormat
+{
+    SHM_FORMAT_BGR = 1, // 3 bytes per pixel, height rows
+    SHM_FORMAT_NV12 = 2 // Y plane followed by the interleaved UV plane, height * 3 / 2 rows
+};
+
+struct ShmRingHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slots;
+    uint32_t slotBytes; // distance between slots, including the slot header
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;
+    uint32_t fpsMilli;                      // nominal frame rate * 1000, 0 if unknown
+    std::atomic<uint32_t> wake;             // futex word, incremented for every published frame
+    std::atomic<uint64_t> head;             // sequence number of the newest published frame, 0 before the first
+    std::atomic<uint64_t> released;         // newest sequence number the consumer is done with
+    std::atomic<int64_t> consumerHeartbeat; // CLOCK_MONOTONIC ms of the consumer's last read, 0 if none
+    std::atomic<uint64_t> dropped;          // frames the producer dropped because the consumer held their slot
+};
+
+struct ShmSlotHeader
+{
+    std::atomic<uint64_t> seq; // sequence number of the frame in the slot
+    uint64_t timestampNs;      // capture time given by the producer
+};
+
+// ShmRingWriter creates a ring and publishes frames into it. It is used by producer processes.
+class ShmRingWriter
+{
+public:
+    ShmRingWriter();
+    ~ShmRingWriter();
+    bool create(const std::string &name, int width, int height, ShmFrameFormat format, int slots, double fps);
+    bool publish(const cv::Mat &frame, uint64_t timestampNs);
+    uint64_t dropped() const;
+    void close();
+
+private:
+    std::string name;
+    ShmRingHeader *header;
+    size_t mappedBytes;
+    uint64_t seq;
+};
+
+// ShmFrameSource reads frames from a ring created by another process without copying them.
+class ShmFrameSource
+{
+public:
+    ShmFrameSource();
+    ~ShmFrameSource();
+    bool open(const std::string &name);
+    bool isOpen() const;
+    cv::Size frameSize() const;
+    bool isNV12() const;
+    double fps() const;
+    bool read(cv::Mat &frame, uint64_t &seq, int timeoutMs);
+    void release(uint64_t seq);
+    uint64_t frames() const;
+    uint64_t skipped() const;
+    uint64_t dropped() const;
+    void close();
+
+private:
+    ShmRingHeader *header;
+    size_t mappedBytes;
+    uint64_t lastSeq;
+    uint64_t frameCount;
+    uint64_t skipCount;
+};
+
+#endif
@@ -0,0 +1,66 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef SHOPSTATS_HPP_INCLUDED
+#define SHOPSTATS_HPP_INCLUDED
+
+#include <cstdint>
+#include <vector>
+#include "tracker.hpp"
+
+// ShoppingInfo contains statistics for the shopping information tracked by the application.
+struct ShoppingInfo
+{
+    int shoppers;
+    int lookers;
+};
+
+// VisitStats summarizes the completed visits of all streams since the application started.
+struct VisitStats
+{
+    uint64_t visits;    // tracks that left the scene
+    uint64_t converted; // visits during which the shopper looked at the shelf
+    uint64_t looks;     // completed looks
+    double conversion;  // converted / visits
+    double dwellAvgMs;
+    double dwellP50Ms;
+    double dwellP90Ms;
+    double gazeAvgMs;
+    double gazeP50Ms;
+    double gazeP90Ms;
+};
+
+/* Shopper statistics are accumulated in shards, one per stream, each on its own cache lines.
+   A stream only updates its own shard with relaxed atomics, so the frame path takes no lock and
+   shares no cache line with other streams. Readers merge the shards when they publish.*/
+struct StatsShard;
+
+StatsShard *acquireStatsShard();
+void releaseStatsShard(StatsShard *shard);
+void recordShoppingInfo(StatsShard *shard, const ShoppingInfo &info);
+void recordTrackEvents(StatsShard *shard, const std::vector<TrackEvent> &events);
+ShoppingInfo currentShoppingInfo();
+ShoppingInfo closeShoppingWindow();
+VisitStats getVisitStats();
+
+#endif
@@ -0,0 +1,79 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef SOAK_HPP_INCLUDED
+#define SOAK_HPP_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// SoakStage names the pipeline stages whose latency a soak run tracks.
+enum SoakStage
+{
+    SoakCapture, // reading one frame from the source
+    SoakQueue,   // waiting between capture and inference
+    SoakFace,    // face preprocessing and inference
+    SoakPose,    // head pose work for all faces of a frame
+    SoakFrame,   // whole frame on the inference thread
+    SoakStages
+};
+
+// SoakConfig describes a soak run and the drift it tolerates.
+struct SoakConfig
+{
+    std::string csvPath;
+    int interval;          // seconds between samples
+    double hours;          // length of the run
+    int warmup;            // seconds before the baseline sample is taken
+    double maxRssGrowth;   // percent growth of resident memory over the baseline
+    double maxP99Growth;   // percent growth of the frame p99 latency over the baseline
+    int driftSamples;      // consecutive samples over a threshold that fail the run
+};
+
+// SoakQueues holds the queue depths sampled by a soak run.
+struct SoakQueues
+{
+    uint64_t frames;    // frames waiting for the inference thread
+    uint64_t outbox;    // MQTT messages waiting in the outbox
+    uint64_t telemetry; // telemetry batches waiting to be sent
+};
+
+typedef std::function<SoakQueues()> SoakQueueProbe;
+
+extern std::atomic<bool> soakOn;
+
+SoakConfig defaultSoakConfig();
+void soakAdd(SoakStage stage, double ms);
+bool soakStart(const SoakConfig &config, SoakQueueProbe probe, std::function<void()> finish);
+bool soakStop();
+
+// soakRecord adds one stage latency sample. It is a relaxed load and branch when no soak runs.
+inline void soakRecord(SoakStage stage, double ms)
+{
+    if (soakOn.load(std::memory_order_relaxed))
+        soakAdd(stage, ms);
+}
+
+#endif
@@ -0,0 +1,118 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef TELEMETRY_HPP_INCLUDED
+#define TELEMETRY_HPP_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// TelemetryEvent is one per-frame count or per-track event.
+struct TelemetryEvent
+{
+    enum Type
+    {
+        Frame = 0,     // a = shoppers, b = lookers
+        Enter = 1,     // a = track id
+        Leave = 2,     // a = track id, b = dwell time in ms
+        LookStart = 3, // a = track id
+        LookEnd = 4    // a = track id, b = look duration in ms
+    };
+    Type type;
+    int64_t timeMs;
+    uint64_t a;
+    uint64_t b;
+};
+
+// TelemetryFormat selects how batches are encoded.
+enum TelemetryFormat
+{
+    TelemetryJSON,
+    TelemetryBinary
+};
+
+// TelemetryStats contains the counters reported for the telemetry stream.
+struct TelemetryStats
+{
+    uint64_t events;
+    uint64_t messages;
+    uint64_t bytes;
+    uint64_t queued; // sealed batches waiting to be sent
+    double seconds;
+};
+
+void putVarint(std::string &out, uint64_t v);
+
+// TelemetrySink delivers one encoded batch.
+typedef std::function<void(const std::string &)> TelemetrySink;
+
+/* TelemetryBatcher packs many events into one message. Events are encoded as they are added and
+   the batch is sealed once it reaches maxBytes; a background thread compresses and sends sealed
+   batches and flushes a partial batch every maxMs.
+
+   The binary format is a flags byte followed by varints: base time in ms, event count, and for
+   every event its type, the time delta from the previous event and one or two fields. When the
+   compression flag is set, everything after the flags byte is deflated.*/
+class TelemetryBatcher
+{
+public:
+    TelemetryBatcher();
+    ~TelemetryBatcher();
+    void start(TelemetryFormat format, bool compress, size_t maxBytes, int maxMs, TelemetrySink sink);
+    void stop();
+    bool isRunning() const;
+    void add(const TelemetryEvent &event);
+    TelemetryStats getStats();
+
+private:
+    void flushRunner();
+    std::string seal();
+
+    TelemetryFormat format;
+    bool compress;
+    size_t maxBytes;
+    int maxMs;
+    TelemetrySink sink;
+
+    std::string body;
+    std::deque<std::string> sealed;
+    uint64_t count;
+    int64_t baseMs;
+    int64_t lastMs;
+    TelemetryStats stats;
+    std::chrono::steady_clock::time_point started;
+
+    std::mutex lock;
+    std::condition_variable full;
+    std::atomic<bool> running;
+    std::thread flushThread;
+};
+
+#endif
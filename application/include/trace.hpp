@@ -0,0 +1,100 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef TRACE_HPP_INCLUDED
+#define TRACE_HPP_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/* Pipeline tracing in the Chrome trace-event format. Every thread records into its own fixed-size
+   ring, so recording is a clock read and a store, and the rings are only read by traceDump. When
+   tracing is off each call is a single relaxed load and branch.*/
+
+extern std::atomic<bool> traceOn;
+
+void traceStart(size_t eventsPerThread);
+void traceThreadName(const char *name);
+void traceEvent(char phase, const char *name, uint64_t frame, uint64_t arg);
+bool traceDump(const std::string &path);
+
+inline bool traceEnabled()
+{
+    return traceOn.load(std::memory_order_relaxed);
+}
+
+// traceBegin opens a span of the calling thread. name must be a string literal.
+inline void traceBegin(const char *name, uint64_t frame, uint64_t arg = 0)
+{
+    if (traceEnabled())
+        traceEvent('B', name, frame, arg);
+}
+
+// traceEnd closes the innermost open span of the calling thread.
+inline void traceEnd(const char *name, uint64_t frame, uint64_t arg = 0)
+{
+    if (traceEnabled())
+        traceEvent('E', name, frame, arg);
+}
+
+// traceAsyncBegin opens a span identified by the frame that may be closed on another thread.
+inline void traceAsyncBegin(const char *name, uint64_t frame)
+{
+    if (traceEnabled())
+        traceEvent('b', name, frame, 0);
+}
+
+inline void traceAsyncEnd(const char *name, uint64_t frame)
+{
+    if (traceEnabled())
+        traceEvent('e', name, frame, 0);
+}
+
+// traceInstant records a point in time, such as a dropped frame.
+inline void traceInstant(const char *name, uint64_t frame)
+{
+    if (traceEnabled())
+        traceEvent('i', name, frame, 0);
+}
+
+// TraceScope records a span for the lifetime of the object.
+class TraceScope
+{
+public:
+    TraceScope(const char *n, uint64_t f, uint64_t a = 0) : name(n), frame(f), arg(a)
+    {
+        traceBegin(name, frame, arg);
+    }
+    ~TraceScope()
+    {
+        traceEnd(name, frame, arg);
+    }
+
+private:
+    const char *name;
+    uint64_t frame;
+    uint64_t arg;
+};
+
+#endif
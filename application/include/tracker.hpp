@@ -0,0 +1,103 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef TRACKER_HPP_INCLUDED
+#define TRACKER_HPP_INCLUDED
+
+#include <cstdint>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+// Track is a face followed across frames.
+struct Track
+{
+    int id;
+    cv::Rect rect;
+    int64_t firstSeenMs;
+    int64_t lastSeenMs;
+    int64_t lookStartMs;
+    int64_t poseMs; // time of the last head pose result, 0 if the track has none
+    float yaw;      // smoothed head yaw and pitch
+    float pitch;
+    int poses;      // head pose results folded into the smoothed pose
+    int poseAge;    // frames since the last head pose result
+    int missed;
+    bool looking;
+    bool converted; // looked at the shelf at least once
+};
+
+// TrackEvent reports a change in the state of a track.
+struct TrackEvent
+{
+    enum Type
+    {
+        Enter,
+        Leave,
+        LookStart,
+        LookEnd
+    };
+    Type type;
+    int trackId;
+    int64_t timeMs;
+    int64_t durationMs; // dwell time for Leave, look duration for LookEnd
+    bool converted;     // for Leave, whether the shopper looked at the shelf during the visit
+};
+
+/* GazeFilter smooths the head pose of each track and applies hysteresis to its looking state:
+   a track starts looking when its smoothed yaw and pitch are both within enterDeg and stops when
+   either leaves exitDeg. A track whose smoothed pose is at least marginDeg away from the threshold
+   that would flip its state may go up to maxSkip frames without head pose inference.*/
+struct GazeFilter
+{
+    bool enabled;
+    float alpha; // weight of a new head pose result in the smoothed pose
+    float enterDeg;
+    float exitDeg;
+    float marginDeg;
+    int maxSkip;
+};
+
+// defaultGazeFilter returns a disabled filter, which applies the plain 22.5 degree looking test.
+GazeFilter defaultGazeFilter();
+
+/* FaceTracker associates face detections with tracks by greedy IoU matching.
+   A track is dropped after maxMissed frames without a matching detection.*/
+class FaceTracker
+{
+public:
+    std::vector<Track> tracks;
+    FaceTracker(float minIou = 0.3f, int maxMissed = 5);
+    std::vector<int> update(const std::vector<cv::Rect> &faces, int64_t nowMs, std::vector<TrackEvent> &events);
+    void setLooking(int trackIndex, bool looking, int64_t nowMs, std::vector<TrackEvent> &events);
+    void setGazeFilter(const GazeFilter &filter);
+    bool needsPose(int trackIndex);
+    bool updatePose(int trackIndex, float yaw, float pitch, int64_t nowMs, std::vector<TrackEvent> &events);
+
+private:
+    GazeFilter gaze;
+    float minIou;
+    int maxMissed;
+    int nextId;
+};
+
+#endif
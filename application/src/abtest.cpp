@@ -0,0 +1,263 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include "abtest.hpp"
+#include "capture.hpp"
+#include "inference.hpp"
+#include "loadgen.hpp"
+#include "percentile.hpp"
+
+using namespace std;
+using namespace cv;
+
+// ABVariant is one face and pose model pair and the timings measured for it.
+struct ABVariant
+{
+    Network face;
+    Network pose;
+    vector<double> faceMs;
+    vector<double> poseMs;
+};
+
+// PoseResult is the head pose of one face.
+struct PoseResult
+{
+    float yaw;
+    float pitch;
+};
+
+ABConfig defaultABConfig()
+{
+    ABConfig config;
+    config.maxFrames = 300;
+    config.nv12 = false;
+    config.minIou = 0.8;
+    config.minCountAgreement = 0.95;
+    config.maxAngleError = 3.0;
+    return config;
+}
+
+static string weightsOf(const string &layers)
+{
+    return layers.substr(0, layers.rfind(".")) + ".bin";
+}
+
+static double msSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+static double mean(const vector<double> &values)
+{
+    double sum = 0;
+    for (double v : values)
+        sum += v;
+    return values.empty() ? 0 : sum / values.size();
+}
+
+static bool isLooking(const PoseResult &p)
+{
+    return p.yaw > -22.5 && p.yaw < 22.5 && p.pitch > -22.5 && p.pitch < 22.5;
+}
+
+// detect runs the variant's face model on a frame
+static void detect(ABVariant &v, const Mat &frame, bool nv12, vector<Rect> &faces)
+{
+    Mat rsImg;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    if (nv12)
+    {
+        v.face.fillInputBlobNV12(frame);
+    }
+    else
+    {
+        resize(frame, rsImg, Size(v.face.getModelWidth(), v.face.getModelHeight()));
+        v.face.fillInputBlob(rsImg);
+    }
+    v.face.inferenceRequest();
+    v.face.wait();
+    v.faceMs.push_back(msSince(start));
+    parseFaces(v.face, frameSize(frame, nv12), faces);
+}
+
+// estimatePose runs the variant's pose model on one face, which must lie inside the frame
+static PoseResult estimatePose(ABVariant &v, const Mat &frame, bool nv12, const Rect &r)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    if (nv12)
+    {
+        Mat bgr;
+        cropNV12ToBGR(frame, r, bgr);
+        v.pose.fillInputSlot(bgr, Rect(0, 0, bgr.cols, bgr.rows), 0);
+    }
+    else
+    {
+        v.pose.fillInputSlot(frame, r, 0);
+    }
+    v.pose.inferenceRequest();
+    v.pose.wait();
+    v.poseMs.push_back(msSince(start));
+
+    float *yaw = v.pose.inference("angle_y_fc");
+    float *pitch = v.pose.inference("angle_p_fc");
+    float *outs = v.pose.inference();
+    PoseResult p = {yaw ? yaw[0] : outs[0], pitch ? pitch[0] : outs[1]};
+    return p;
+}
+
+static bool inside(const Rect &r, Size size)
+{
+    return (r & Rect(0, 0, size.width, size.height)) == r;
+}
+
+static bool loadVariant(ABVariant &v, const string &face, const string &pose, const ABConfig &config)
+{
+    v.face.isAsync = 0;
+    v.pose.isAsync = 0;
+    v.face.nv12Input = config.nv12;
+    return v.face.loadNetwork(face, weightsOf(face), v.face.ie, config.device) == 0 &&
+           v.pose.loadNetwork(pose, weightsOf(pose), v.face.ie, config.device) == 0;
+}
+
+static void printTimings(const char *name, const vector<double> &a, const vector<double> &b)
+{
+    cout << name << " latency p50/p99 ms: A " << percentile(a, 0.5) << "/" << percentile(a, 0.99)
+         << ", B " << percentile(b, 0.5) << "/" << percentile(b, 0.99)
+         << "; throughput per second: A " << (mean(a) > 0 ? 1000 / mean(a) : 0)
+         << ", B " << (mean(b) > 0 ? 1000 / mean(b) : 0) << endl;
+}
+
+/* runPrecisionAB runs both variants of the face and pose models over the same cached frames
+   and prints one report of their speed and of how far B's results are from A's. Each variant
+   runs the whole pipeline on its own detections for the shopper and looker counts. Box IoU
+   pairs each A face with the best overlapping B face, and the pose error compares both pose
+   models on the faces found by A, so it measures the pose model alone.*/
+int runPrecisionAB(const string &input, const ABConfig &config)
+{
+    FrameCache cache;
+    if (!cache.load(input, config.maxFrames, config.nv12))
+    {
+        return -1;
+    }
+
+    ABVariant a, b;
+    if (!loadVariant(a, config.faceA, config.poseA, config) || !loadVariant(b, config.faceB, config.poseB, config))
+    {
+        return -1;
+    }
+
+    size_t matched = 0, missed = 0, extra = 0;
+    size_t sameShoppers = 0, sameLookers = 0, sameLooking = 0, poses = 0;
+    double iouSum = 0;
+    vector<double> yawError, pitchError;
+    for (const Mat &frame : cache.frames)
+    {
+        Size size = frameSize(frame, config.nv12);
+        vector<Rect> facesA, facesB;
+        detect(a, frame, config.nv12, facesA);
+        detect(b, frame, config.nv12, facesB);
+
+        // Pair each A face with its best overlapping B face
+        vector<bool> used(facesB.size(), false);
+        for (auto const &fa : facesA)
+        {
+            int best = -1;
+            double bestIou = 0.5;
+            for (size_t j = 0; j < facesB.size(); j++)
+            {
+                int inter = (fa & facesB[j]).area();
+                double iou = (double)inter / (fa.area() + facesB[j].area() - inter);
+                if (!used[j] && iou >= bestIou)
+                {
+                    best = j;
+                    bestIou = iou;
+                }
+            }
+            if (best < 0)
+            {
+                missed++;
+                continue;
+            }
+            used[best] = true;
+            matched++;
+            iouSum += bestIou;
+        }
+        extra += count(used.begin(), used.end(), false);
+
+        // Pose both models on A's faces, and B's pose model on B's faces for B's looker count
+        int lookersA = 0, lookersB = 0;
+        for (auto const &r : facesA)
+        {
+            if (!inside(r, size))
+                continue;
+            PoseResult pa = estimatePose(a, frame, config.nv12, r);
+            PoseResult pb = estimatePose(b, frame, config.nv12, r);
+            yawError.push_back(fabs(pa.yaw - pb.yaw));
+            pitchError.push_back(fabs(pa.pitch - pb.pitch));
+            poses++;
+            if (isLooking(pa) == isLooking(pb))
+                sameLooking++;
+            if (isLooking(pa))
+                lookersA++;
+        }
+        for (auto const &r : facesB)
+        {
+            if (inside(r, size) && isLooking(estimatePose(b, frame, config.nv12, r)))
+                lookersB++;
+        }
+
+        if (facesA.size() == facesB.size())
+            sameShoppers++;
+        if (lookersA == lookersB)
+            sameLookers++;
+    }
+
+    size_t frames = cache.frames.size();
+    double meanIou = matched ? iouSum / matched : 1.0;
+    double shopperAgreement = frames ? (double)sameShoppers / frames : 1.0;
+    double lookerAgreement = frames ? (double)sameLookers / frames : 1.0;
+    double yawMean = mean(yawError), pitchMean = mean(pitchError);
+
+    cout << "Precision A/B over " << frames << " frames on " << config.device << endl;
+    cout << "A: " << config.faceA << ", " << config.poseA << endl;
+    cout << "B: " << config.faceB << ", " << config.poseB << endl;
+    printTimings("Face", a.faceMs, b.faceMs);
+    printTimings("Pose", a.poseMs, b.poseMs);
+    cout << "Face boxes: " << matched << " matched, " << missed << " missed by B, " << extra << " found only by B, mean IoU " << meanIou << endl;
+    cout << "Shopper count agreement: " << 100 * shopperAgreement << "% of frames" << endl;
+    cout << "Looker count agreement: " << 100 * lookerAgreement << "% of frames" << endl;
+    cout << "Yaw error deg: mean " << yawMean << ", p95 " << percentile(yawError, 0.95) << "; pitch error deg: mean "
+         << pitchMean << ", p95 " << percentile(pitchError, 0.95) << endl;
+    cout << "Looking decision agreement: " << (poses ? 100.0 * sameLooking / poses : 100.0) << "% of faces" << endl;
+
+    bool pass = meanIou >= config.minIou && shopperAgreement >= config.minCountAgreement &&
+                lookerAgreement >= config.minCountAgreement && yawMean <= config.maxAngleError && pitchMean <= config.maxAngleError;
+    cout << "B is " << (pass ? "within" : "outside") << " the accuracy limits (IoU >= " << config.minIou
+         << ", count agreement >= " << 100 * config.minCountAgreement << "%, angle error <= " << config.maxAngleError << " deg)" << endl;
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,111 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include "budget.hpp"
+
+PoseBudget::PoseBudget() : limitMs(0), frames(0), overruns(0), poseRun(0), poseSkipped(0), carried(0), worstUs(0)
+{
+}
+
+// configure sets the per-frame budget in milliseconds, 0 disables it
+void PoseBudget::configure(double budgetMs)
+{
+    limitMs = std::max(0.0, budgetMs);
+}
+
+bool PoseBudget::isEnabled() const
+{
+    return limitMs > 0;
+}
+
+double PoseBudget::budgetMs() const
+{
+    return limitMs;
+}
+
+/* order returns the face indexes in the order they should get head pose inference. Faces of
+   tracks that never had a head pose come first, since they have no state to carry. The rest are
+   ranked by size, as larger faces are closer to the shelf, weighted by how long ago their track
+   was last checked so that small faces are not starved.*/
+std::vector<size_t> PoseBudget::order(const std::vector<cv::Rect> &faces, const std::vector<int> &trackIndex,
+                                      const std::vector<Track> &tracks, int64_t nowMs) const
+{
+    std::vector<std::pair<double, size_t> > ranked;
+    ranked.reserve(faces.size());
+    for (size_t f = 0; f < faces.size(); f++)
+    {
+        const Track &t = tracks[trackIndex[f]];
+        double score;
+        if (t.poseMs == 0)
+            score = 1e300;
+        else
+            score = faces[f].area() * (1.0 + (nowMs - t.poseMs) / 1000.0);
+        ranked.push_back(std::make_pair(score, f));
+    }
+    std::stable_sort(ranked.begin(), ranked.end(), [](const std::pair<double, size_t> &a, const std::pair<double, size_t> &b) {
+        return a.first > b.first;
+    });
+
+    std::vector<size_t> result;
+    result.reserve(ranked.size());
+    for (auto const &r : ranked)
+        result.push_back(r.second);
+    return result;
+}
+
+// fits reports whether one more pose batch of the estimated cost still fits in the budget
+bool PoseBudget::fits(double elapsedMs, double batchCostMs) const
+{
+    return !isEnabled() || elapsedMs + batchCostMs <= limitMs;
+}
+
+// recordFrame adds one processed frame to the counters
+void PoseBudget::recordFrame(double elapsedMs, size_t run, size_t skipped, size_t carriedFaces)
+{
+    frames++;
+    if (isEnabled() && elapsedMs > limitMs)
+        overruns++;
+    poseRun += run;
+    poseSkipped += skipped;
+    carried += carriedFaces;
+
+    uint64_t us = (uint64_t)(elapsedMs * 1000);
+    uint64_t worst = worstUs.load(std::memory_order_relaxed);
+    while (us > worst && !worstUs.compare_exchange_weak(worst, us, std::memory_order_relaxed))
+    {
+    }
+}
+
+BudgetStats PoseBudget::getStats() const
+{
+    BudgetStats stats;
+    stats.frames = frames.load();
+    stats.overruns = overruns.load();
+    stats.poseRun = poseRun.load();
+    stats.poseSkipped = poseSkipped.load();
+    stats.carried = carried.load();
+    stats.unknown = stats.poseSkipped - std::min(stats.poseSkipped, stats.carried);
+    stats.worstMs = worstUs.load() / 1000.0;
+    return stats;
+}
@@ -0,0 +1,83 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <cstring>
+#include <opencv2/imgproc/imgproc.hpp>
+#include "capture.hpp"
+
+/* openVideoSource opens a video file or a camera ID. In NV12 mode the frames are pulled through
+   GStreamer in the decoder's native NV12 layout; videoconvert only runs when the decoder or
+   camera produces another YUV layout.*/
+bool openVideoSource(cv::VideoCapture &cap, const std::string &input, bool nv12)
+{
+    bool camera = input.size() == 1 && input[0] >= '0' && input[0] <= '9';
+    if (!nv12)
+    {
+        if (camera)
+            cap.open(std::stoi(input));
+        else
+            cap.open(input);
+        return cap.isOpened();
+    }
+
+    std::string source = camera ? "v4l2src device=/dev/video" + input : "filesrc location=\"" + input + "\" ! decodebin";
+    cap.open(source + " ! videoconvert ! video/x-raw,format=NV12 ! appsink", cv::CAP_GSTREAMER);
+    return cap.isOpened();
+}
+
+// frameSize returns the image size of a frame, which for NV12 is smaller than the Mat.
+cv::Size frameSize(const cv::Mat &frame, bool nv12)
+{
+    return nv12 ? cv::Size(frame.cols, frame.rows * 2 / 3) : cv::Size(frame.cols, frame.rows);
+}
+
+/* cropNV12ToBGR converts only the region of interest of an NV12 frame to BGR. The region is
+   widened to even coordinates, as the chroma is shared by 2x2 pixel blocks.*/
+void cropNV12ToBGR(const cv::Mat &nv12, const cv::Rect &roi, cv::Mat &bgr)
+{
+    int height = nv12.rows * 2 / 3;
+    int x0 = roi.x & ~1;
+    int y0 = roi.y & ~1;
+    int x1 = std::min(nv12.cols, (roi.x + roi.width + 1) & ~1);
+    int y1 = std::min(height, (roi.y + roi.height + 1) & ~1);
+    int w = x1 - x0;
+    int h = y1 - y0;
+
+    cv::Mat crop(h * 3 / 2, w, CV_8UC1);
+    for (int y = 0; y < h; y++)
+    {
+        memcpy(crop.ptr(y), nv12.ptr(y0 + y) + x0, w);
+    }
+    for (int y = 0; y < h / 2; y++)
+    {
+        memcpy(crop.ptr(h + y), nv12.ptr(height + y0 / 2 + y) + x0, w);
+    }
+    cv::cvtColor(crop, bgr, cv::COLOR_YUV2BGR_NV12);
+
+    // Trim the widening again so the crop covers exactly the requested region
+    if (x0 != roi.x || y0 != roi.y || w != roi.width || h != roi.height)
+    {
+        bgr = bgr(cv::Rect(roi.x - x0, roi.y - y0, roi.width, roi.height) & cv::Rect(0, 0, w, h));
+    }
+}
@@ -0,0 +1,138 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <cmath>
+#include <zlib.h>
+#include "heatmap.hpp"
+#include "telemetry.hpp"
+
+static const uint8_t heatmapVersion = 1;
+static const uint32_t heatmapSample = 256;
+static const int64_t heatmapTickMs = 1000;
+static const size_t heatmapMaxDecayTicks = 65536;
+
+GazeHeatmap::GazeHeatmap()
+{
+    config.cols = 0;
+    config.rows = 0;
+    config.distance = 0.5;
+    config.halfLife = 300;
+    config.interval = 10;
+}
+
+/* configure allocates the grid and the decay table once. It returns false and leaves the heatmap
+   disabled unless the grid has at least one cell and the half life is positive.*/
+bool GazeHeatmap::configure(const HeatmapConfig &c)
+{
+    if (c.cols < 1 || c.rows < 1 || !(c.halfLife > 0) || std::isinf(c.halfLife) || !(c.distance >= 0) || c.interval < 0)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    config = c;
+    weight.assign(config.cols * config.rows, 0);
+    lastTick.assign(config.cols * config.rows, 0);
+
+    // Past the end of the table a weight has decayed below one Q8 step, so it is treated as zero
+    decay.clear();
+    for (size_t t = 0; t < heatmapMaxDecayTicks; t++)
+    {
+        uint32_t f = (uint32_t)(65536.0 * std::pow(0.5, t / config.halfLife) + 0.5);
+        if (f == 0)
+            break;
+        decay.push_back(f);
+    }
+    return true;
+}
+
+bool GazeHeatmap::isEnabled() const
+{
+    return config.cols > 0 && config.rows > 0;
+}
+
+int GazeHeatmap::interval() const
+{
+    return config.interval;
+}
+
+uint32_t GazeHeatmap::decayed(size_t cell, uint32_t tick) const
+{
+    uint32_t elapsed = tick - lastTick[cell];
+    if (elapsed >= decay.size())
+        return 0;
+    return (uint32_t)(((uint64_t)weight[cell] * decay[elapsed]) >> 16);
+}
+
+/* addGaze projects the gaze of a face onto the shelf grid. The face position is normalized to
+   the frame, and the gaze moves across the grid by tan(angle) times the shelf distance.*/
+void GazeHeatmap::addGaze(float faceX, float faceY, float yawDeg, float pitchDeg, int64_t nowMs)
+{
+    if (!isEnabled())
+        return;
+
+    const float degToRad = 3.14159265f / 180.0f;
+    float x = faceX - std::tan(yawDeg * degToRad) * config.distance;
+    float y = faceY + std::tan(pitchDeg * degToRad) * config.distance;
+    if (!(x >= 0 && x < 1 && y >= 0 && y < 1))
+        return;
+
+    size_t cell = (size_t)(y * config.rows) * config.cols + (size_t)(x * config.cols);
+    uint32_t tick = (uint32_t)(nowMs / heatmapTickMs);
+
+    std::lock_guard<std::mutex> guard(lock);
+    uint32_t w = decayed(cell, tick);
+    weight[cell] = w > UINT32_MAX - heatmapSample ? UINT32_MAX : w + heatmapSample;
+    lastTick[cell] = tick;
+}
+
+/* snapshot returns the decayed grid as a version byte, varints for columns, rows and time in ms,
+   and the deflated cell weights as little-endian 32-bit Q8 values in row-major order.*/
+std::string GazeHeatmap::snapshot(int64_t nowMs)
+{
+    std::vector<uint8_t> cells(config.cols * config.rows * 4);
+    uint32_t tick = (uint32_t)(nowMs / heatmapTickMs);
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (size_t i = 0; i < weight.size(); i++)
+        {
+            uint32_t w = decayed(i, tick);
+            cells[4 * i] = w & 0xFF;
+            cells[4 * i + 1] = (w >> 8) & 0xFF;
+            cells[4 * i + 2] = (w >> 16) & 0xFF;
+            cells[4 * i + 3] = w >> 24;
+        }
+    }
+
+    std::string out(1, (char)heatmapVersion);
+    putVarint(out, config.cols);
+    putVarint(out, config.rows);
+    putVarint(out, nowMs);
+
+    uLongf size = compressBound(cells.size());
+    std::vector<Bytef> packed(size);
+    if (compress2(packed.data(), &size, cells.data(), cells.size(), Z_BEST_SPEED) != Z_OK)
+        return std::string();
+    out.append(reinterpret_cast<const char *>(packed.data()), size);
+    return out;
+}
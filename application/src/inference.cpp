@@ -20,9 +20,12 @@
 * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
 * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
+#include <algorithm>
+#include <exception>
 #include <iostream>
 #include <string>
 #include "inference.hpp"
+#include "preprocess.hpp"
 
 // Default Constructor
 Network::Network()
@@ -31,10 +34,13 @@ Network::Network()
     modelWidth = 0;
     maxProposalCount = -1;
     conf_batchSize = 1;
+    conf_inputWidth = 0;
+    conf_inputHeight = 0;
+    nv12Input = false;
 }
 
 // Load the plugin and configure the network
-int Network::loadNetwork(std::string conf_modelLayers, std::string conf_modelWeights, InferenceEngine::Core ie, std::string myTargetDevice)
+int Network::loadNetwork(std::string conf_modelLayers, std::string conf_modelWeights, InferenceEngine::Core &ie, std::string myTargetDevice)
 {
     // Configure network
 //    InferenceEngine::CNNNetReader networkReader;
@@ -43,16 +49,44 @@ int Network::loadNetwork(std::string conf_modelLayers, std::string conf_modelWei
 //    networkReader.getNetwork().setBatchSize(conf_batchSize);
 
     auto cnnNetwork = ie.ReadNetwork(conf_modelLayers);
+
+    // Reshape the input to the requested resolution, keeping the batch and channels of the IR
+    if (conf_inputWidth > 0 && conf_inputHeight > 0)
+    {
+        auto shapes = cnnNetwork.getInputShapes();
+        for (auto &shape : shapes)
+        {
+            if (shape.second.size() == 4)
+            {
+                shape.second[2] = conf_inputHeight;
+                shape.second[3] = conf_inputWidth;
+            }
+        }
+        try
+        {
+            cnnNetwork.reshape(shapes);
+        }
+        catch (const std::exception &e)
+        {
+            std::cout << "Could not reshape " << conf_modelLayers << " to " << conf_inputWidth << "x" << conf_inputHeight
+                      << ": " << e.what() << std::endl;
+            return -1;
+        }
+    }
+    if (conf_batchSize > 1)
+    {
+        cnnNetwork.setBatchSize(conf_batchSize);
+    }
     // Get input info
-    inputInfo = new InferenceEngine::InputsDataMap(cnnNetwork.getInputsInfo());
+    inputInfo = cnnNetwork.getInputsInfo();
 
-    if (inputInfo->size() != 1)
+    if (inputInfo.size() != 1)
     {
         std::cout << "This application only supports networks with one input\n";
         return -1;
     }
-    inputName = &(inputInfo->begin()->first);
-    inputDims = inputInfo->begin()->second->getTensorDesc().getDims();
+    inputName = inputInfo.begin()->first;
+    inputDims = inputInfo.begin()->second->getTensorDesc().getDims();
     if (inputDims.size() != 4)
     {
         std::cout << "Not supported input dimensions size, expected 4, got "
@@ -67,8 +101,16 @@ int Network::loadNetwork(std::string conf_modelLayers, std::string conf_modelWei
     inputSize = channelSize * modelChannels;
 
     // Set input info
-    (*inputInfo)[*inputName]->setPrecision(InferenceEngine::Precision::U8);
-    (*inputInfo)[*inputName]->setLayout(InferenceEngine::Layout::NCHW);
+    inputInfo[inputName]->setPrecision(InferenceEngine::Precision::U8);
+    inputInfo[inputName]->setLayout(InferenceEngine::Layout::NCHW);
+
+    // Let the plugin convert and resize NV12 frames as part of inference
+    if (nv12Input)
+    {
+        InferenceEngine::PreProcessInfo &preProcess = inputInfo[inputName]->getPreProcess();
+        preProcess.setResizeAlgorithm(InferenceEngine::RESIZE_BILINEAR);
+        preProcess.setColorFormat(InferenceEngine::ColorFormat::NV12);
+    }
 
     // Get output info
     InferenceEngine::OutputsDataMap outputInfo(cnnNetwork.getOutputsInfo());
@@ -79,7 +121,11 @@ int Network::loadNetwork(std::string conf_modelLayers, std::string conf_modelWei
     objectSize = outputDims[3];       // SSD output per object
 
     // Set output info
-    output->setPrecision(InferenceEngine::Precision::FP32);
+    for (auto &out : outputInfo)
+    {
+        out.second->setPrecision(InferenceEngine::Precision::FP32);
+        outputNames.push_back(out.first);
+    }
 
     // Load model into plugin
     network = ie.LoadNetwork(cnnNetwork, myTargetDevice);
@@ -122,6 +168,24 @@ void Network::cvMatToBlob(const cv::Mat &img, InferenceEngine::Blob::Ptr &blob)
     return;
 }
 
+// Set the input resolution the network is reshaped to when it is loaded, 0 keeps the resolution of the IR
+void Network::setInputSize(size_t width, size_t height)
+{
+    conf_inputWidth = width;
+    conf_inputHeight = height;
+}
+
+// Set the batch size used when the network is loaded
+void Network::setBatchSize(size_t batchSize)
+{
+    conf_batchSize = batchSize;
+}
+
+size_t Network::getBatchSize()
+{
+    return conf_batchSize;
+}
+
 size_t Network::getModelHeight()
 {
     return modelHeight;
@@ -135,19 +199,56 @@ size_t Network::getModelWidth()
 void *Network::wait()
 {
 currInfReq->Wait(InferenceEngine::IInferRequest::WaitMode::RESULT_READY);
+return NULL;
 }
 
 // Fill Input Blob
-void Network::fillInputBlob(cv::Mat img)
+void Network::fillInputBlob(const cv::Mat &img)
 {
     InferenceEngine::Blob::Ptr inputBlob;
     if(isAsync)
-        inputBlob = nextInfReq->GetBlob(*inputName);
+        inputBlob = nextInfReq->GetBlob(inputName);
     else
-        inputBlob = currInfReq->GetBlob(*inputName);
+        inputBlob = currInfReq->GetBlob(inputName);
     cvMatToBlob<uchar>(img, inputBlob);
 }
 
+// Fill one batch slot of the Input Blob straight from a region of a BGR image
+void Network::fillInputSlot(const cv::Mat &img, const cv::Rect &roi, size_t slot)
+{
+    InferenceEngine::Blob::Ptr inputBlob;
+    if(isAsync)
+        inputBlob = nextInfReq->GetBlob(inputName);
+    else
+        inputBlob = currInfReq->GetBlob(inputName);
+    uint8_t *slotData = inputBlob->buffer().as<uint8_t *>() + slot * inputSize;
+    cropResizeToPlanar(img, roi, slotData, modelWidth, modelHeight);
+}
+
+/* Fill Input Blob from a full resolution NV12 frame without copying it. The frame is kept
+   referenced until the request using it is reused.*/
+void Network::fillInputBlobNV12(const cv::Mat &nv12)
+{
+    size_t width = nv12.cols;
+    size_t height = nv12.rows * 2 / 3;
+    InferenceEngine::TensorDesc yDesc(InferenceEngine::Precision::U8, {1, 1, height, width}, InferenceEngine::Layout::NHWC);
+    InferenceEngine::TensorDesc uvDesc(InferenceEngine::Precision::U8, {1, 2, height / 2, width / 2}, InferenceEngine::Layout::NHWC);
+    InferenceEngine::Blob::Ptr yBlob = InferenceEngine::make_shared_blob<uint8_t>(yDesc, nv12.data);
+    InferenceEngine::Blob::Ptr uvBlob = InferenceEngine::make_shared_blob<uint8_t>(uvDesc, nv12.data + width * height);
+    InferenceEngine::Blob::Ptr blob = InferenceEngine::make_shared_blob<InferenceEngine::NV12Blob>(yBlob, uvBlob);
+
+    if(isAsync)
+    {
+        nextInput = nv12;
+        nextInfReq->SetBlob(inputName, blob);
+    }
+    else
+    {
+        currInput = nv12;
+        currInfReq->SetBlob(inputName, blob);
+    }
+}
+
 // Create inference request
 void Network::inferenceRequest()
 {
@@ -160,6 +261,7 @@ void Network::inferenceRequest()
 void Network::swapInferenceRequest()
 {
     currInfReq.swap(nextInfReq);
+    std::swap(currInput, nextInput);
 }
 
 // Get the inference output
@@ -167,3 +269,33 @@ float *Network::inference()
 {
     return currInfReq->GetBlob(outputName)->buffer().as<InferenceEngine::PrecisionTrait<InferenceEngine::Precision::FP32>::value_type *>();
 }
+
+// Get the named inference output, or NULL if the network has no such output
+float *Network::inference(const std::string &name)
+{
+    if (std::find(outputNames.begin(), outputNames.end(), name) == outputNames.end())
+        return NULL;
+    return currInfReq->GetBlob(name)->buffer().as<InferenceEngine::PrecisionTrait<InferenceEngine::Precision::FP32>::value_type *>();
+}
+
+// Collect the confident face detections of the last inference, scaled to a frame of the given size
+void parseFaces(Network &net, cv::Size size, std::vector<cv::Rect> &faces)
+{
+    float *results = net.inference();
+    for (int i = 0; i < net.maxProposalCount; i++)
+    {
+        float *result = results + i * net.objectSize;
+        float confidence = result[2];
+        if (confidence > 0.5)
+        {
+            int left = (int)(result[3] * size.width);
+            int top = (int)(result[4] * size.height);
+            int right = (int)(result[5] * size.width);
+            int bottom = (int)(result[6] * size.height);
+            int width = right - left + 1;
+            int height = bottom - top + 1;
+
+            faces.push_back(cv::Rect(left, top, width, height));
+        }
+    }
+}
@@ -0,0 +1,302 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <thread>
+#include <opencv2/videoio/videoio.hpp>
+#include "capture.hpp"
+#include "loadgen.hpp"
+#include "percentile.hpp"
+
+typedef std::chrono::steady_clock lgclock;
+
+// Frames queued for the workers are dropped once this many frame periods of backlog build up.
+static const int maxBacklogPerStream = 4;
+
+// LoadJob is one frame of one virtual stream, stamped with the time it was due to arrive.
+struct LoadJob
+{
+    const cv::Mat *frame;
+    int stream;
+    lgclock::time_point due;
+};
+
+// StreamArrival is the next scheduled arrival of one virtual stream.
+struct StreamArrival
+{
+    lgclock::time_point nominal;
+    lgclock::time_point due;
+    int stream;
+    size_t frame;
+    bool operator>(const StreamArrival &other) const
+    {
+        return due > other.due;
+    }
+};
+
+FrameCache::FrameCache()
+{
+    fps = 0;
+}
+
+// load decodes up to maxFrames frames of the input once and keeps them in memory.
+bool FrameCache::load(const std::string &input, int maxFrames, bool nv12)
+{
+    cv::VideoCapture cap;
+    if (!openVideoSource(cap, input, nv12))
+    {
+        std::cerr << "ERROR! Unable to open video source for the frame cache\n";
+        return false;
+    }
+
+    fps = cap.get(cv::CAP_PROP_FPS);
+    frames.clear();
+    while ((int)frames.size() < maxFrames)
+    {
+        cv::Mat frame;
+        if (!cap.read(frame) || frame.empty())
+        {
+            break;
+        }
+        frames.push_back(frame);
+    }
+    cap.release();
+
+    return !frames.empty();
+}
+
+// defaultLoadGenConfig returns the settings used when config.json has no loadgen section.
+LoadGenConfig defaultLoadGenConfig()
+{
+    LoadGenConfig config;
+    config.streams = 4;
+    config.maxStreams = 64;
+    config.maxFrames = 300;
+    config.duration = 20;
+    config.fps = 0;
+    config.offsetMs = -1;
+    config.jitterMs = 0;
+    config.targetP99Ms = 100;
+    return config;
+}
+
+// runLoadStep replays the frame cache as the given number of virtual streams for config.duration seconds.
+LoadGenResult runLoadStep(const FrameCache &cache, const LoadGenConfig &config, int streams, std::vector<FrameProcessor> &workers,
+                          WorkerInit init)
+{
+    double fps = config.fps > 0 ? config.fps : (cache.fps > 0 ? cache.fps : 30);
+    lgclock::duration period = std::chrono::duration_cast<lgclock::duration>(std::chrono::duration<double>(1.0 / fps));
+    double offsetMs = config.offsetMs >= 0 ? config.offsetMs : 1000.0 / fps / streams;
+    size_t maxBacklog = (size_t)(streams * maxBacklogPerStream);
+
+    std::deque<LoadJob> jobs;
+    std::mutex jobsLock;
+    std::condition_variable jobsReady;
+    bool producing = true;
+    long dropped = 0;
+
+    std::vector<std::vector<double> > latencies(workers.size());
+    std::vector<std::thread> threads;
+    for (size_t w = 0; w < workers.size(); w++)
+    {
+        threads.push_back(std::thread([&, w]() {
+            if (init)
+            {
+                init(w);
+            }
+            for (;;)
+            {
+                // A worker serves the streams whose index maps to it, so each stream's frames are
+                // processed in order against that stream's own state
+                LoadJob job;
+                {
+                    std::unique_lock<std::mutex> lock(jobsLock);
+                    std::deque<LoadJob>::iterator mine;
+                    jobsReady.wait(lock, [&]() {
+                        mine = std::find_if(jobs.begin(), jobs.end(), [&](const LoadJob &j) { return (size_t)j.stream % workers.size() == w; });
+                        return mine != jobs.end() || !producing;
+                    });
+                    if (mine == jobs.end())
+                    {
+                        return;
+                    }
+                    job = *mine;
+                    jobs.erase(mine);
+                }
+                workers[w](*job.frame, job.stream);
+                std::chrono::duration<double, std::milli> latency = lgclock::now() - job.due;
+                latencies[w].push_back(latency.count());
+            }
+        }));
+    }
+
+    // A single scheduler thread releases every stream's frames at their due time
+    std::mt19937 rng(streams);
+    std::uniform_real_distribution<double> jitter(-config.jitterMs, config.jitterMs);
+    std::priority_queue<StreamArrival, std::vector<StreamArrival>, std::greater<StreamArrival> > arrivals;
+    lgclock::time_point start = lgclock::now();
+    lgclock::time_point end = start + std::chrono::seconds(config.duration);
+    for (int s = 0; s < streams; s++)
+    {
+        StreamArrival a;
+        a.nominal = start + std::chrono::duration_cast<lgclock::duration>(std::chrono::duration<double, std::milli>(s * offsetMs));
+        a.due = a.nominal;
+        a.stream = s;
+        a.frame = (size_t)s % cache.frames.size();
+        arrivals.push(a);
+    }
+
+    while (!arrivals.empty() && arrivals.top().due < end)
+    {
+        StreamArrival a = arrivals.top();
+        arrivals.pop();
+        std::this_thread::sleep_until(a.due);
+
+        {
+            std::lock_guard<std::mutex> lock(jobsLock);
+            if (jobs.size() >= maxBacklog)
+            {
+                dropped++;
+            }
+            else
+            {
+                LoadJob job;
+                job.frame = &cache.frames[a.frame];
+                job.stream = a.stream;
+                job.due = a.due;
+                jobs.push_back(job);
+            }
+        }
+        jobsReady.notify_all();
+
+        a.nominal += period;
+        a.due = a.nominal;
+        if (config.jitterMs > 0)
+        {
+            a.due += std::chrono::duration_cast<lgclock::duration>(std::chrono::duration<double, std::milli>(jitter(rng)));
+        }
+        a.frame = (a.frame + 1) % cache.frames.size();
+        arrivals.push(a);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(jobsLock);
+        producing = false;
+    }
+    jobsReady.notify_all();
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+    double elapsed = std::chrono::duration<double>(lgclock::now() - start).count();
+
+    std::vector<double> all;
+    for (auto const &l : latencies)
+    {
+        all.insert(all.end(), l.begin(), l.end());
+    }
+
+    LoadGenResult result;
+    result.streams = streams;
+    result.frames = (long)all.size();
+    result.dropped = dropped;
+    result.throughput = elapsed > 0 ? all.size() / elapsed : 0;
+    result.p50Ms = percentile(all, 0.5);
+    result.p99Ms = percentile(all, 0.99);
+    double sum = 0, sumSq = 0;
+    for (double l : all)
+    {
+        sum += l;
+        sumSq += l * l;
+    }
+    double mean = all.empty() ? 0 : sum / all.size();
+    result.jitterMs = all.empty() ? 0 : std::sqrt(std::max(0.0, sumSq / all.size() - mean * mean));
+    result.sustainable = dropped == 0 && result.p99Ms <= config.targetP99Ms;
+    return result;
+}
+
+void printLoadStep(const LoadGenResult &r)
+{
+    std::cout << "streams: " << r.streams
+              << ", frames: " << r.frames
+              << ", dropped: " << r.dropped
+              << ", throughput: " << r.throughput << " fps"
+              << ", p50: " << r.p50Ms << " ms"
+              << ", p99: " << r.p99Ms << " ms"
+              << ", jitter: " << r.jitterMs << " ms"
+              << (r.sustainable ? "" : " (over budget)") << std::endl;
+}
+
+/* runLoadGen searches for the largest number of virtual streams the workers sustain at the target p99 latency.
+   The stream count is doubled until the target is missed, then bisected between the last passing and first failing count.*/
+int runLoadGen(const FrameCache &cache, const LoadGenConfig &config, std::vector<FrameProcessor> &workers)
+{
+    if (cache.frames.empty() || workers.empty())
+    {
+        return 0;
+    }
+
+    int pass = 0;
+    int fail = config.maxStreams + 1;
+    int streams = 1;
+    while (streams <= config.maxStreams)
+    {
+        LoadGenResult r = runLoadStep(cache, config, streams, workers);
+        printLoadStep(r);
+        if (!r.sustainable)
+        {
+            fail = streams;
+            break;
+        }
+        pass = streams;
+        streams *= 2;
+    }
+    if (pass == 0 && fail == 1)
+    {
+        std::cout << "Sustainable streams: 0 at p99 <= " << config.targetP99Ms << " ms" << std::endl;
+        return 0;
+    }
+    fail = std::min(fail, config.maxStreams + 1);
+
+    while (fail - pass > 1)
+    {
+        int mid = pass + (fail - pass) / 2;
+        LoadGenResult r = runLoadStep(cache, config, mid, workers);
+        printLoadStep(r);
+        if (r.sustainable)
+            pass = mid;
+        else
+            fail = mid;
+    }
+
+    std::cout << "Sustainable streams: " << pass << " at p99 <= " << config.targetP99Ms << " ms" << std::endl;
+    return pass;
+}
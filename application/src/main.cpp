@@ -22,7 +22,9 @@
 */
 
 // Std includes
+#include <algorithm>
 #include <iostream>
+#include <map>
 #include <thread>
 #include <queue>
 #include <mutex>
@@ -30,8 +32,23 @@
 #include <csignal>
 #include <string>
 #include <fstream>
+#include <functional>
 // OpenCV includes
 #include "inference.hpp"
+#include "abtest.hpp"
+#include "loadgen.hpp"
+#include "capture.hpp"
+#include "heatmap.hpp"
+#include "outbox.hpp"
+#include "placement.hpp"
+#include "telemetry.hpp"
+#include "trace.hpp"
+#include "tracker.hpp"
+#include "budget.hpp"
+#include "shopstats.hpp"
+#include "resolution.hpp"
+#include "shmring.hpp"
+#include "soak.hpp"
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/opencv.hpp>
 #include <opencv2/highgui/highgui.hpp>
@@ -50,27 +67,79 @@ json jsonobj;
 // Flag to control background threads
 atomic<bool> keepRunning(true);
 
+// Flag set by SIGUSR1 to dump the pipeline trace, which the messaging thread writes to tracePath
+atomic<bool> dumpTrace(false);
+string tracePath;
+
 // OpenCV-related variables
-bool poseChecked = false;
+atomic<bool> poseChecked(false);
 bool isAsyncmode = true;
+bool ingestNV12 = false;
+bool showDisplay = true;
 
 // Application parameters
 int rate;
 
-// shoppingInfo contains statistics for the shopping information tracked by this application.
-struct ShoppingInfo
+/* faceNets holds the face detector at each runtime resolution except the largest, which is the
+   main face network, smallest first. faceResolution is the selector every stream starts from.*/
+std::vector<Network> faceNets;
+ResolutionSelector faceResolution;
+
+// Gaze smoothing, hysteresis and head pose reuse applied to the tracks of every stream
+GazeFilter gazeFilter = defaultGazeFilter();
+
+// StreamState contains the per-stream state carried from one frame to the next.
+struct StreamState
 {
-    int shoppers;
-    int lookers;
+    uint64_t frameId;
+    FaceTracker tracker;
+    std::vector<TrackEvent> events;
+    double poseBatchMs; // running estimate of the wall time of one head pose batch
+    StatsShard *stats;  // shopper statistics of this stream
+    ResolutionSelector resolution;
+    uint64_t frames;
+    uint64_t poseRun;      // head pose results computed
+    uint64_t poseReused;   // faces whose looking state was reused from an earlier frame
+    uint64_t countChanges; // frames whose lookers count differs from the previous frame
+    int lastLookers;
+    StreamState() : frameId(0), poseBatchMs(0), stats(acquireStatsShard()), frames(0), poseRun(0), poseReused(0), countChanges(0), lastLookers(0)
+    {
+        tracker.setGazeFilter(gazeFilter);
+    }
+    ~StreamState()
+    {
+        releaseStatsShard(stats);
+    }
+    StreamState(const StreamState &) = delete;
+    StreamState &operator=(const StreamState &) = delete;
 };
 
-// currentInfo contains the latest ShoppingInfo tracked by the application.
-ShoppingInfo currentInfo;
-
-std::queue<Mat> nextImage;
+std::queue<std::pair<Mat, uint64_t> > nextImage;
+std::chrono::steady_clock::time_point queuedAt; // when the frame in nextImage was queued
 String currentPerf;
 
-std::mutex m, m1, m2;
+std::mutex m, m1;
+
+// outbox buffers MQTT messages on disk while the broker is unreachable.
+Outbox outbox;
+
+// shmSource maps frames published by an external decoder process when the input is shm:<name>.
+ShmFrameSource shmSource;
+
+// poseBudget bounds the head pose work done for each frame.
+PoseBudget poseBudget;
+
+// telemetry batches the per-frame and per-track events.
+TelemetryBatcher telemetry;
+
+// heatmap accumulates where on the shelf the lookers look.
+GazeHeatmap heatmap;
+
+// placement pins the capture, inference and messaging threads to CPUs or NUMA nodes.
+PlacementConfig placement;
+
+// Number of frame buffers the capture loop cycles through
+const int framePoolSize = 4;
 
 const cv::String keys =
     "{ help  h     | | Print help message. }"
@@ -79,67 +148,98 @@ const cv::String keys =
     "{ model m     | | Path to .xml file of model containing face recognizer. }"
     "{ posemodel pm | | Path to .xml file of face pose model. }"
     "{ flag      f | | flag to run on sync or async mode. }"
-    "{ rate r      | 1 | number of seconds between data updates to MQTT server. }";
+    "{ rate r      | 1 | number of seconds between data updates to MQTT server. }"
+    "{ loadgen lg  | | Replay the input as virtual streams to find how many streams this box sustains. }"
+    "{ outbox ob   | | file buffering MQTT messages while the broker is unreachable, such as outbox.dat. }"
+    "{ outboxsize obs | 4 | size of the MQTT outbox in MiB. }"
+    "{ telemetry t | none | per-frame and per-track event stream: none, json or binary. }"
+    "{ compress z  | | deflate binary telemetry batches. }"
+    "{ batchbytes tb | 1024 | size in bytes at which a telemetry batch is sent. }"
+    "{ batchms tm  | 1000 | milliseconds after which a partial telemetry batch is sent. }"
+    "{ trace tr    | | file receiving a Chrome trace of the pipeline at exit and on SIGUSR1. }"
+    "{ tracesize   | 65536 | number of trace events kept per thread. }"
+    "{ placementbench pb | | compare pinned and unpinned throughput and jitter with the load generator. }"
+    "{ budget bms  | 0 | per-frame latency budget in milliseconds, 0 runs head pose on every face. }"
+    "{ faceres fr  | | face detector input as WIDTHxHEIGHT, or auto to switch between the face_resolutions of the config file. }"
+    "{ resbench rb | | report face detection throughput and recall at each of the face_resolutions of the config file. }"
+    "{ abtest ab   | | compare the models against the variants given with -mb and -pmb, such as FP16 or INT8 IRs. }"
+    "{ modelb mb   | | Path to .xml file of the face detection variant compared by -ab. }"
+    "{ posemodelb pmb | | Path to .xml file of the face pose variant compared by -ab. }"
+    "{ posebatch psb | 1 | number of faces sent to the head pose network in one inference. }"
+    "{ preprocbench ppb | | compare the head pose preprocessing paths on the first input frame. }"
+    "{ gazefilter gf | | smooth head poses, apply hysteresis to the looking test and reuse poses of confident faces. }"
+    "{ gazebench gb | | compare head pose inferences and lookers count stability with and without the gaze filter. }"
+    "{ nv12        | | keep frames in the decoder's NV12 layout and let the plugin convert them. }"
+    "{ soak        | | loop the input for hours, sampling memory, queues and latency into a CSV, and fail on drift. }"
+    "{ nodisplay nd | | do not show the video window. }";
 
-// nextImageAvailable returns the next image from the queue in a thread-safe way
-Mat nextImageAvailable()
+// nextImageAvailable returns the next image and its frame ID from the queue in a thread-safe way
+Mat nextImageAvailable(uint64_t &frameId)
 {
     Mat rtn;
     m.lock();
     if (!nextImage.empty())
     {
-        rtn = nextImage.front();
+        rtn = nextImage.front().first;
+        frameId = nextImage.front().second;
         nextImage.pop();
+        traceAsyncEnd("queue", frameId);
+        soakRecord(SoakQueue, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - queuedAt).count());
     }
     m.unlock();
     return rtn;
 }
 
 // addImage adds an image to the queue in a thread-safe way
-void addImage(Mat img)
+void addImage(Mat img, uint64_t frameId)
 {
     m.lock();
     if (nextImage.empty())
     {
-        nextImage.push(img);
+        nextImage.push(std::make_pair(img, frameId));
+        queuedAt = std::chrono::steady_clock::now();
+        traceAsyncBegin("queue", frameId);
+    }
+    else
+    {
+        traceInstant("dropped", frameId);
     }
     m.unlock();
 }
 
-// getCurrentInfo returns the most-recent ShoppingInfo for the application.
-ShoppingInfo getCurrentInfo()
+/* nextFrameBuffer returns a buffer of the pool that no other thread still references, so capture
+   never overwrites a frame that is queued or being inferred. If all are busy, the decoder allocates.*/
+Mat nextFrameBuffer(std::vector<Mat> &pool)
 {
-    ShoppingInfo rtn;
-    m2.lock();
-    rtn = currentInfo;
-    m2.unlock();
-    return rtn;
+    for (auto const &b : pool)
+    {
+        // Other threads drop their references concurrently, so the count is read atomically
+        if (b.u && CV_XADD(&b.u->refcount, 0) == 1)
+        {
+            return b;
+        }
+    }
+    return Mat();
 }
 
-/* updateInfo updates the current ShoppingInfo for the application to the highest values
-   during the current time period.*/
-void updateInfo(ShoppingInfo info)
+// getCurrentInfo returns the highest ShoppingInfo of any stream during the current time period.
+ShoppingInfo getCurrentInfo()
 {
-    m2.lock();
-    if (currentInfo.shoppers < info.shoppers)
-    {
-        currentInfo.shoppers = info.shoppers;
-    }
+    return currentShoppingInfo();
+}
 
-    if (currentInfo.lookers < info.lookers)
-    {
-        currentInfo.lookers = info.lookers;
-    }
-    m2.unlock();
+/* updateInfo records the ShoppingInfo and track events of a frame in the stream's own statistics
+   shard, which needs no lock.*/
+void updateInfo(StreamState &state, const ShoppingInfo &info)
+{
+    recordShoppingInfo(state.stats, info);
+    recordTrackEvents(state.stats, state.events);
 }
 
-// resetInfo resets the current ShoppingInfo for the application.
-void resetInfo()
+// resetInfo starts a new time period and returns the ShoppingInfo of the one that ended.
+ShoppingInfo resetInfo()
 {
-    m2.lock();
-    currentInfo.shoppers = 0;
-    currentInfo.lookers = 0;
-    m2.unlock();
+    return closeShoppingWindow();
 }
 
 // getCurrentPerf returns a string with the current performance stats for the Inference Engine.
@@ -159,7 +259,7 @@ void savePerformanceInfo(double infer_time_face, double infer_time_pose)
     std::string label;
     double t = infer_time_face * 1000;
     double t2;
-    if (poseChecked)
+    if (poseChecked.load())
     {
         t2 = infer_time_pose * 1000;
     }
@@ -171,6 +271,15 @@ void savePerformanceInfo(double infer_time_face, double infer_time_pose)
     m1.unlock();
 }
 
+// Send MQTT message through the outbox when it is enabled
+void sendMQTTMessage(const string &topic, const string &payload)
+{
+    if (outbox.isOpen())
+        outbox.push(topic, payload);
+    else
+        mqtt_publish(topic, payload);
+}
+
 // Publish MQTT message with a JSON payload
 void publishMQTTMessage(const string &topic, const ShoppingInfo &info)
 {
@@ -179,128 +288,742 @@ void publishMQTTMessage(const string &topic, const ShoppingInfo &info)
     list << "\"lookers\": \"" << info.lookers << "\"}";
     std::string payload = list.str();
 
-    mqtt_publish(topic, payload);
+    sendMQTTMessage(topic, payload);
 
     string msg = "MQTT message published to topic: " + topic;
 }
 
+// Publish the MQTT outbox metrics directly, so they are current rather than replayed from the backlog
+void publishOutboxStats(const string &topic)
+{
+    OutboxStats stats = outbox.getStats();
+    std::ostringstream list;
+    list << "{\"pending\": " << stats.pending << ",";
+    list << "\"pending_bytes\": " << stats.pendingBytes << ",";
+    list << "\"dropped\": " << stats.dropped << ",";
+    list << "\"replayed\": " << stats.replayed << ",";
+    list << "\"replay_rate\": " << stats.replayRate << "}";
+
+    if (mqtt_is_connected())
+        mqtt_publish(topic, list.str());
+}
+
+// Signal handler requesting a dump of the pipeline trace
+void handleTraceSignal(int)
+{
+    dumpTrace = true;
+}
+
 // Message handler for the MQTT subscription for the any desired control channel topic
 int handleMQTTControlMessages(void *context, char *topicName, int topicLen, MQTTClient_message *message)
 {
     string topic = topicName;
     string msg = "MQTT message received: " + topic;
+
+    // Returning 1 hands ownership of the message and topic to the application
+    MQTTClient_freeMessage(&message);
+    MQTTClient_free(topicName);
     return 1;
 }
 
-// Function called by worker thread to process the next available video frame.
-void frameRunner(Network net, Network net_pose)
+// addTrackEvents forwards the track events of a frame to the telemetry stream.
+void addTrackEvents(std::vector<TrackEvent> &events)
 {
-    while (keepRunning.load())
+    static const TelemetryEvent::Type types[] = {TelemetryEvent::Enter, TelemetryEvent::Leave, TelemetryEvent::LookStart, TelemetryEvent::LookEnd};
+    for (auto const &e : events)
     {
-        Mat next = nextImageAvailable();
-        if (!next.empty())
+        TelemetryEvent t = {types[e.type], e.timeMs, (uint64_t)e.trackId, (uint64_t)std::max<int64_t>(0, e.durationMs)};
+        telemetry.add(t);
+    }
+    events.clear();
+}
+
+// inferPoseBatch runs head pose inference on the filled batch slots and updates the gaze of each face's track.
+std::chrono::duration<float> inferPoseBatch(Network &net_pose, StreamState &state, const std::vector<Rect> &faces, const std::vector<int> &trackIndex,
+                                            const std::vector<size_t> &batch, Size size, int64_t nowMs, int &looking)
+{
+    traceBegin("pose inference", state.frameId, batch.front());
+    std::chrono::high_resolution_clock::time_point infer_start_time_pose = std::chrono::high_resolution_clock::now();
+    net_pose.inferenceRequest();
+    std::chrono::high_resolution_clock::time_point infer_end_time_pose = std::chrono::high_resolution_clock::now();
+    net_pose.wait();
+    traceEnd("pose inference", state.frameId, batch.front());
+    poseChecked.store(true);
+
+    // Batched outputs hold one yaw and one pitch per slot, and the request just waited on is the one
+    // whose slots were filled with batch, so slot k belongs to face batch[k]. A model without the named outputs
+    // returns both angles of a slot next to each other in its single output.
+    float *yaw = net_pose.inference("angle_y_fc");
+    float *pitch = net_pose.inference("angle_p_fc");
+    float *outs = net_pose.inference();
+    for (size_t k = 0; k < batch.size(); k++)
+    {
+        size_t f = batch[k];
+        const Rect &r = faces[f];
+        float y = yaw ? yaw[k] : outs[2 * k];
+        float p = pitch ? pitch[k] : outs[2 * k + 1];
+
+        // The shopper is looking if their head is tilted within a 45 degree angle relative to the shelf
+        if (state.tracker.updatePose(trackIndex[f], y, p, nowMs, state.events))
         {
-            std::chrono::duration<float> infer_time_face;
-            std::chrono::duration<float> infer_time_pose;
-            cv::Mat rsImg, rsImg_pose;
-            cv::resize(next, rsImg, cv::Size(net.getModelWidth(), net.getModelHeight()));
-            net.fillInputBlob(rsImg);
-            std::chrono::high_resolution_clock::time_point infer_start_time = std::chrono::high_resolution_clock::now();
-            net.inferenceRequest();
-            std::chrono::high_resolution_clock::time_point infer_end_time = std::chrono::high_resolution_clock::now();
-            infer_time_face = std::chrono::duration_cast<std::chrono::duration<float>>(infer_end_time - infer_start_time);
-            net.wait();
-
-            // Get inference results
-            float *results = net.inference();
-
-            // Get faces
-            std::vector<float> confidences;
-            std::vector<Rect> faces;
-            int looking = 0;
-            for (int i = 0; i < net.maxProposalCount; i++)
+            looking++;
+            if (heatmap.isEnabled())
+                heatmap.addGaze((r.x + r.width / 2.0f) / size.width, (r.y + r.height / 2.0f) / size.height, y, p, nowMs);
+        }
+    }
+
+    return std::chrono::duration_cast<std::chrono::duration<float>>(infer_end_time_pose - infer_start_time_pose);
+}
+
+// faceNetwork returns the face detector for a resolution index of the stream's ResolutionSelector.
+Network &faceNetwork(Network &net, size_t resolution)
+{
+    return resolution < faceNets.size() ? faceNets[resolution] : net;
+}
+
+// updatePoseCost folds the wall time of the pose batch started at batchStart into the stream's estimate.
+void updatePoseCost(StreamState &state, std::chrono::steady_clock::time_point batchStart)
+{
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - batchStart).count();
+    if (state.poseBatchMs == 0)
+        state.poseBatchMs = ms;
+    else
+        state.poseBatchMs = 0.8 * state.poseBatchMs + 0.2 * ms;
+}
+
+// processFrame runs face and head pose inference on one frame and records the resulting ShoppingInfo.
+ShoppingInfo processFrame(Network &net, Network &net_pose, StreamState &state, const Mat &next)
+{
+    std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+    int64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    std::chrono::duration<float> infer_time_face;
+    std::chrono::duration<float> infer_time_pose;
+    cv::Mat rsImg;
+    Size size = frameSize(next, ingestNV12);
+
+    // Pick the face detector resolution for this frame
+    size_t resolution = 0;
+    if (state.resolution.isEnabled())
+        resolution = state.resolution.choose(state.frameId);
+    Network &detector = faceNetwork(net, resolution);
+
+    std::chrono::steady_clock::time_point faceStart = std::chrono::steady_clock::now();
+    traceBegin("face preprocess", state.frameId);
+    if (ingestNV12)
+    {
+        detector.fillInputBlobNV12(next);
+    }
+    else
+    {
+        cv::resize(next, rsImg, cv::Size(detector.getModelWidth(), detector.getModelHeight()));
+        detector.fillInputBlob(rsImg);
+    }
+    traceEnd("face preprocess", state.frameId);
+    traceBegin("face inference", state.frameId);
+    std::chrono::high_resolution_clock::time_point infer_start_time = std::chrono::high_resolution_clock::now();
+    detector.inferenceRequest();
+    std::chrono::high_resolution_clock::time_point infer_end_time = std::chrono::high_resolution_clock::now();
+    infer_time_face = std::chrono::duration_cast<std::chrono::duration<float>>(infer_end_time - infer_start_time);
+    detector.wait();
+    traceEnd("face inference", state.frameId);
+    std::chrono::steady_clock::time_point poseStart = std::chrono::steady_clock::now();
+    soakRecord(SoakFace, std::chrono::duration<double, std::milli>(poseStart - faceStart).count());
+
+    // Get faces
+    std::vector<Rect> faces;
+    int looking = 0;
+    parseFaces(detector, size, faces);
+    if (state.resolution.isEnabled())
+        state.resolution.observe(faces, size.height, resolution);
+
+    std::vector<int> trackIndex = state.tracker.update(faces, nowMs, state.events);
+
+    // Look for poses, filling up to one batch of pose inputs before each inference. Confident tracks
+    // keep their looking state without inference. With a latency budget, faces are served in priority
+    // order and the ones that do not fit keep their track's state.
+    std::vector<size_t> order;
+    if (poseBudget.isEnabled())
+    {
+        order = poseBudget.order(faces, trackIndex, state.tracker.tracks, nowMs);
+    }
+    else
+    {
+        for (size_t f = 0; f < faces.size(); f++)
+            order.push_back(f);
+    }
+    size_t batchSize = net_pose.getBatchSize();
+    std::vector<size_t> batch;
+    size_t posed = 0, skipped = 0, carried = 0, reused = 0;
+    cv::Mat faceBGR;
+    std::chrono::steady_clock::time_point batchStart;
+    infer_time_pose = std::chrono::duration<float>::zero();
+    for (size_t f : order)
+    {
+        const Rect &r = faces[f];
+        // Make sure the face rect is completely inside the main Mat
+        if ((r & Rect(0, 0, size.width, size.height)) != r)
+        {
+            continue;
+        }
+
+        if (!state.tracker.needsPose(trackIndex[f]))
+        {
+            // A reused looking face still lands on the heatmap, at its track's smoothed gaze
+            const Track &track = state.tracker.tracks[trackIndex[f]];
+            reused++;
+            if (track.looking)
             {
-                float *result = results + i * net.objectSize;
-                float imageID = result[0];
-                int label = static_cast<int>(result[1]);
-                float confidence = result[2];
-                if (confidence > 0.5)
-                {
-                    int left = (int)(result[3] * next.cols);
-                    int top = (int)(result[4] * next.rows);
-                    int right = (int)(result[5] * next.cols);
-                    int bottom = (int)(result[6] * next.rows);
-                    int width = right - left + 1;
-                    int height = bottom - top + 1;
-
-                    faces.push_back(Rect(left, top, width, height));
-                    confidences.push_back(confidence);
-                }
+                looking++;
+                if (heatmap.isEnabled())
+                    heatmap.addGaze((r.x + r.width / 2.0f) / size.width, (r.y + r.height / 2.0f) / size.height, track.yaw, track.pitch, nowMs);
             }
+            continue;
+        }
 
-            // Look for poses
-            for (auto const &r : faces)
+        if (batch.empty())
+        {
+            // The first batch of a frame always runs when it serves a track that never had a pose, so
+            // new shoppers get a looking state and the batch cost is measured again even over budget
+            double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+            bool probe = posed == 0 && state.tracker.tracks[trackIndex[f]].poseMs == 0;
+            if (!probe && !poseBudget.fits(elapsedMs, state.poseBatchMs))
             {
-                // Make sure the face rect is completely inside the main Mat
-                if ((r & Rect(0, 0, next.cols, next.rows)) != r)
+                const Track &track = state.tracker.tracks[trackIndex[f]];
+                skipped++;
+                if (track.poseMs > 0)
                 {
-                    continue;
+                    carried++;
+                    if (track.looking)
+                        looking++;
                 }
+                traceInstant("pose skipped", state.frameId);
+                continue;
+            }
+            batchStart = std::chrono::steady_clock::now();
+        }
 
-                cv::Mat face = next(r);
+        // Crop, resize and convert to planar straight into the batch slot
+        traceBegin("pose preprocess", state.frameId, f);
+        if (ingestNV12)
+        {
+            cropNV12ToBGR(next, r, faceBGR);
+            net_pose.fillInputSlot(faceBGR, Rect(0, 0, faceBGR.cols, faceBGR.rows), batch.size());
+        }
+        else
+        {
+            net_pose.fillInputSlot(next, r, batch.size());
+        }
+        traceEnd("pose preprocess", state.frameId, f);
+        batch.push_back(f);
 
-                // Convert to 4d vector, and process thru neural network
-                cv::resize(face, rsImg_pose, cv::Size(net_pose.getModelWidth(), net_pose.getModelHeight()));
+        if (batch.size() == batchSize)
+        {
+            infer_time_pose += inferPoseBatch(net_pose, state, faces, trackIndex, batch, size, nowMs, looking);
+            updatePoseCost(state, batchStart);
+            posed += batch.size();
+            batch.clear();
+        }
+    }
+    if (!batch.empty())
+    {
+        infer_time_pose += inferPoseBatch(net_pose, state, faces, trackIndex, batch, size, nowMs, looking);
+        updatePoseCost(state, batchStart);
+        posed += batch.size();
+    }
 
-                net_pose.fillInputBlob(rsImg_pose);
+    // Without a measurement in this frame, let the cost estimate decay so that one slow batch does
+    // not keep head pose from running on known tracks for good
+    if (posed == 0 && skipped > 0)
+        state.poseBatchMs *= 0.9;
 
-                std::chrono::high_resolution_clock::time_point infer_start_time_pose = std::chrono::high_resolution_clock::now();
+    soakRecord(SoakPose, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - poseStart).count());
 
-                net_pose.inferenceRequest();
-                std::chrono::high_resolution_clock::time_point infer_end_time_pose = std::chrono::high_resolution_clock::now();
-                infer_time_pose = std::chrono::duration_cast<std::chrono::duration<float>>(infer_end_time_pose - infer_start_time_pose);
-                net_pose.wait();
-                float *outs = net_pose.inference();
-                poseChecked = true;
+    // Retail data
+    ShoppingInfo info;
+    info.shoppers = faces.size();
+    info.lookers = looking;
+    updateInfo(state, info);
 
-                // The shopper is looking if their head is tilted within a 45 degree angle relative to the shelf
-                if ((outs[0] > -22.5) && (outs[0] < 22.5) &&
-                    (outs[1] > -22.5) && (outs[1] < 22.5))
-                {
-                    looking++;
-                }
-            if(isAsyncmode)
-                net_pose.swapInferenceRequest();
+    state.frames++;
+    state.poseRun += posed;
+    state.poseReused += reused;
+    if (state.frames > 1 && info.lookers != state.lastLookers)
+        state.countChanges++;
+    state.lastLookers = info.lookers;
 
-            }
+    if (telemetry.isRunning())
+    {
+        TelemetryEvent counts = {TelemetryEvent::Frame, nowMs, (uint64_t)info.shoppers, (uint64_t)info.lookers};
+        telemetry.add(counts);
+        addTrackEvents(state.events);
+    }
+    state.events.clear();
+
+    savePerformanceInfo(infer_time_face.count(), infer_time_pose.count());
+    if(detector.isAsync)
+        detector.swapInferenceRequest();
+
+    double frameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+    if (poseBudget.isEnabled() && frameMs > poseBudget.budgetMs())
+        traceInstant("budget overrun", state.frameId);
+    poseBudget.recordFrame(frameMs, posed, skipped, carried);
+    soakRecord(SoakFrame, frameMs);
+
+    return info;
+}
+
+// printGazeStats reports the head pose inferences run and saved by a stream and the stability of its lookers count.
+void printGazeStats(const string &label, const StreamState &state)
+{
+    uint64_t faces = state.poseRun + state.poseReused;
+    cout << label << ": " << state.frames << " frames, " << state.poseRun << " head pose inferences, "
+         << state.poseReused << " reused (" << (faces ? 100.0 * state.poseReused / faces : 0) << "%), lookers count changed in "
+         << (state.frames > 1 ? 100.0 * state.countChanges / (state.frames - 1) : 0) << "% of frames" << endl;
+}
 
-            // Retail data
-            ShoppingInfo info;
-            info.shoppers = faces.size();
-            info.lookers = looking;
-            updateInfo(info);
+// Function called by worker thread to process the next available video frame.
+void frameRunner(Network &net, Network &net_pose)
+{
+    StreamState state;
+    state.resolution = faceResolution;
+    uint64_t held = 0; // shared memory frame still read by an async face inference request
+    pinCurrentThread(placement.inference);
+    traceThreadName("inference");
+    while (keepRunning.load())
+    {
+        Mat next = nextImageAvailable(state.frameId);
+        if (!next.empty())
+        {
+            TraceScope scope("frame", state.frameId);
+            processFrame(net, net_pose, state, next);
 
-            savePerformanceInfo(infer_time_face.count(), infer_time_pose.count());
-            if(isAsyncmode)
-                net.swapInferenceRequest();
+            // In async mode the face request of a frame, which may read the ring slot in place,
+            // is only waited on while the next frame is processed, so release one frame behind
+            if (shmSource.isOpen() && net.isAsync)
+            {
+                if (held)
+                    shmSource.release(held);
+                held = state.frameId;
+            }
+            else if (shmSource.isOpen())
+            {
+                shmSource.release(state.frameId);
+            }
         }
 
     }
+    if (gazeFilter.enabled)
+        printGazeStats("Gaze filter", state);
     cout << "Video processing thread stopped" << endl;
 }
 
+// publishVisitStats publishes the dwell, gaze and conversion statistics of all streams.
+void publishVisitStats(const string &topic)
+{
+    VisitStats stats = getVisitStats();
+    std::ostringstream list;
+    list << "{\"visits\": " << stats.visits << ",";
+    list << "\"converted\": " << stats.converted << ",";
+    list << "\"conversion\": " << stats.conversion << ",";
+    list << "\"dwell_avg_ms\": " << stats.dwellAvgMs << ",";
+    list << "\"dwell_p50_ms\": " << stats.dwellP50Ms << ",";
+    list << "\"dwell_p90_ms\": " << stats.dwellP90Ms << ",";
+    list << "\"looks\": " << stats.looks << ",";
+    list << "\"gaze_avg_ms\": " << stats.gazeAvgMs << ",";
+    list << "\"gaze_p50_ms\": " << stats.gazeP50Ms << ",";
+    list << "\"gaze_p90_ms\": " << stats.gazeP90Ms << "}";
+
+    sendMQTTMessage(topic, list.str());
+}
+
+// budgetStatsMessage formats the latency budget counters as a JSON message.
+string budgetStatsMessage()
+{
+    BudgetStats stats = poseBudget.getStats();
+    std::ostringstream list;
+    list << "{\"budget_ms\": " << poseBudget.budgetMs() << ",";
+    list << "\"frames\": " << stats.frames << ",";
+    list << "\"overruns\": " << stats.overruns << ",";
+    list << "\"worst_ms\": " << stats.worstMs << ",";
+    list << "\"pose_run\": " << stats.poseRun << ",";
+    list << "\"pose_skipped\": " << stats.poseSkipped << ",";
+    list << "\"carried\": " << stats.carried << ",";
+    list << "\"unknown\": " << stats.unknown << "}";
+    return list.str();
+}
+
 // Function called by worker thread to handle MQTT updates. Pauses for rate second(s) between updates.
 void messageRunner()
 {
+    std::chrono::steady_clock::time_point lastSnapshot = std::chrono::steady_clock::now();
+    pinCurrentThread(placement.messaging);
+    traceThreadName("messaging");
     while (keepRunning.load())
     {
-        publishMQTTMessage("retail/traffic", getCurrentInfo());
-        resetInfo();
+        traceBegin("publish", 0);
+        publishMQTTMessage("retail/traffic", resetInfo());
+        publishVisitStats("retail/visits");
+        if (outbox.isOpen())
+            publishOutboxStats("retail/outbox");
+        if (poseBudget.isEnabled())
+            sendMQTTMessage("retail/budget", budgetStatsMessage());
+
+        if (heatmap.isEnabled() && std::chrono::steady_clock::now() - lastSnapshot >= std::chrono::seconds(heatmap.interval()))
+        {
+            int64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            sendMQTTMessage("retail/heatmap", heatmap.snapshot(nowMs));
+            lastSnapshot = std::chrono::steady_clock::now();
+        }
+        traceEnd("publish", 0);
+
+        // The trace is written here rather than on the capture thread, which it is meant to diagnose
+        if (dumpTrace.exchange(false))
+            traceDump(tracePath);
         std::this_thread::sleep_for(std::chrono::seconds(rate));
     }
     cout << "MQTT sender thread stopped" << endl;
 }
 
+// pluginPlacementConfig returns the CPU plugin settings of the thread placement, binding the plugin threads as bind says.
+std::map<std::string, std::string> pluginPlacementConfig(const std::string &bind)
+{
+    std::map<std::string, std::string> pluginConfig;
+    if (!bind.empty())
+        pluginConfig["CPU_BIND_THREAD"] = bind;
+    if (placement.pluginThreads > 0)
+        pluginConfig["CPU_THREADS_NUM"] = std::to_string(placement.pluginThreads);
+    return pluginConfig;
+}
+
+// LoadGenWorkers holds the networks and stream states behind a set of load generator workers.
+struct LoadGenWorkers
+{
+    std::vector<Network> nets;
+    std::vector<std::map<int, StreamState> > streams; // state of each virtual stream, by worker
+    std::vector<FrameProcessor> workers;
+};
+
+/* loadWorkers prepares count workers with the settings of net and net_pose. Every worker needs its own
+   infer requests, so each one loads its own copy of both networks with the plugin threads bound as bind
+   says, except that with reuseMain the first worker runs on net and net_pose themselves. A worker
+   serves several virtual streams, each with its own StreamState, so face detection runs in sync mode
+   to keep every result with the frame and stream it came from.*/
+bool loadWorkers(LoadGenWorkers &set, int count, Network &net, Network &net_pose, bool reuseMain,
+                 const string &modelLayers, const string &modelLayers_pose, const string &device, const string &bind)
+{
+    int first = reuseMain ? 1 : 0;
+    set.nets = std::vector<Network>(2 * (count - first));
+    set.streams = std::vector<std::map<int, StreamState> >(count);
+    set.workers.clear();
+    if (reuseMain)
+    {
+        std::map<int, StreamState> &streams = set.streams[0];
+        net.isAsync = 0;
+        set.workers.push_back([&net, &net_pose, &streams](const Mat &frame, int stream) {
+            StreamState &state = streams[stream];
+            state.frameId++;
+            processFrame(net, net_pose, state, frame);
+        });
+    }
+    string weights = modelLayers.substr(0, modelLayers.rfind(".")) + ".bin";
+    string weights_pose = modelLayers_pose.substr(0, modelLayers_pose.rfind(".")) + ".bin";
+    std::map<std::string, std::string> pluginConfig = pluginPlacementConfig(bind);
+    for (int w = first; w < count; w++)
+    {
+        Network &face = set.nets[2 * (w - first)];
+        Network &pose = set.nets[2 * (w - first) + 1];
+        face.isAsync = 0;
+        face.nv12Input = net.nv12Input;
+        face.setInputSize(net.getModelWidth(), net.getModelHeight());
+        pose.isAsync = 0;
+        pose.setBatchSize(net_pose.getBatchSize());
+        if (!pluginConfig.empty() && device.find("CPU") != std::string::npos)
+            face.ie.SetConfig(pluginConfig, "CPU");
+        if (face.loadNetwork(modelLayers, weights, face.ie, device) != 0 ||
+            pose.loadNetwork(modelLayers_pose, weights_pose, face.ie, device) != 0)
+        {
+            return false;
+        }
+        std::map<int, StreamState> &streams = set.streams[w];
+        set.workers.push_back([&face, &pose, &streams](const Mat &frame, int stream) {
+            StreamState &state = streams[stream];
+            state.frameId++;
+            processFrame(face, pose, state, frame);
+        });
+    }
+    return true;
+}
+
+/* runLoadGenerator decodes the input once and replays it as virtual streams through one or more
+   face/pose network pairs, then reports the number of streams sustained at the target p99 latency.
+   With benchPlacement it instead compares a fixed number of streams with and without pinning and plugin thread binding.*/
+int runLoadGenerator(const string &input, Network &net, Network &net_pose,
+                     const string &modelLayers, const string &modelLayers_pose, const string &device, bool benchPlacement)
+{
+    LoadGenConfig config = defaultLoadGenConfig();
+    int workerCount = 1;
+    if (jsonobj.count("loadgen"))
+    {
+        json lg = jsonobj["loadgen"];
+        config.streams = lg.value("streams", config.streams);
+        config.maxStreams = lg.value("max_streams", config.maxStreams);
+        config.maxFrames = lg.value("max_frames", config.maxFrames);
+        config.duration = lg.value("duration", config.duration);
+        config.fps = lg.value("fps", config.fps);
+        config.offsetMs = lg.value("offset_ms", config.offsetMs);
+        config.jitterMs = lg.value("jitter_ms", config.jitterMs);
+        config.targetP99Ms = lg.value("p99_ms", config.targetP99Ms);
+        workerCount = std::max(1, lg.value("workers", workerCount));
+    }
+
+    // Decode the cache on the inference CPUs so its pages are local to the workers that read them
+    std::vector<int> original = currentThreadCpus();
+    pinCurrentThread(placement.inference);
+    FrameCache cache;
+    bool loaded = cache.load(input, config.maxFrames, ingestNV12);
+    pinCurrentThread(original);
+    if (!loaded)
+    {
+        return -1;
+    }
+    cout << "Frame cache: " << cache.frames.size() << " frames at " << cache.fps << " fps" << endl;
+
+    LoadGenWorkers set;
+    if (!benchPlacement)
+    {
+        if (!loadWorkers(set, workerCount, net, net_pose, true, modelLayers, modelLayers_pose, device, placement.pluginBind))
+            return -1;
+        runLoadGen(cache, config, set.workers);
+        if (poseBudget.isEnabled())
+            cout << "Latency budget: " << budgetStatsMessage() << endl;
+        return 0;
+    }
+
+    // The unpinned runs also leave the plugin threads unbound. The runs alternate as unpinned, pinned,
+    // pinned, unpinned so that warm-up and thermal drift weigh on both sides alike.
+    LoadGenWorkers unbound;
+    if (!loadWorkers(unbound, workerCount, net, net_pose, false, modelLayers, modelLayers_pose, device, "NO") ||
+        !loadWorkers(set, workerCount, net, net_pose, true, modelLayers, modelLayers_pose, device, placement.pluginBind))
+    {
+        return -1;
+    }
+    LoadGenResult unpinned = {}, pinned = {};
+    for (int run = 0; run < 4; run++)
+    {
+        bool pin = run == 1 || run == 2;
+        LoadGenResult r;
+        if (pin)
+        {
+            cout << "Pinned to CPUs " << describeCpuSet(placement.inference) << ":" << endl;
+            r = runLoadStep(cache, config, config.streams, set.workers, [](size_t) { pinCurrentThread(placement.inference); });
+        }
+        else
+        {
+            cout << "Unpinned:" << endl;
+            r = runLoadStep(cache, config, config.streams, unbound.workers);
+        }
+        printLoadStep(r);
+        LoadGenResult &sum = pin ? pinned : unpinned;
+        sum.throughput += r.throughput / 2;
+        sum.jitterMs += r.jitterMs / 2;
+    }
+    if (unpinned.throughput > 0 && unpinned.jitterMs > 0)
+    {
+        cout << "Pinned/unpinned throughput: " << pinned.throughput / unpinned.throughput
+             << ", jitter: " << pinned.jitterMs / unpinned.jitterMs << endl;
+    }
+    return 0;
+}
+
+// configResolutions returns the face_resolutions of the config file, smallest first.
+std::vector<cv::Size> configResolutions()
+{
+    std::vector<cv::Size> sizes;
+    if (jsonobj.count("face_resolutions"))
+    {
+        for (auto const &r : jsonobj["face_resolutions"])
+        {
+            cv::Size size;
+            if (parseResolution(r.get<string>(), size))
+                sizes.push_back(size);
+            else
+                cout << "Ignoring face resolution " << r.get<string>() << endl;
+        }
+    }
+    std::sort(sizes.begin(), sizes.end(), [](const cv::Size &a, const cv::Size &b) { return a.height < b.height; });
+    return sizes;
+}
+
+// countMatches counts the reference faces overlapped by a detection with an IoU of at least 0.5.
+size_t countMatches(const std::vector<Rect> &reference, const std::vector<Rect> &found)
+{
+    std::vector<bool> used(found.size(), false);
+    size_t matched = 0;
+    for (auto const &r : reference)
+    {
+        for (size_t f = 0; f < found.size(); f++)
+        {
+            int inter = (r & found[f]).area();
+            if (!used[f] && 2 * inter >= r.area() + found[f].area() - inter)
+            {
+                used[f] = true;
+                matched++;
+                break;
+            }
+        }
+    }
+    return matched;
+}
+
+/* runResolutionBench runs the face detector over the cached input at each resolution and reports its
+   throughput and its recall against the detections made at the largest resolution. */
+int runResolutionBench(const string &input, const string &modelLayers, const string &device, const std::vector<cv::Size> &resolutions)
+{
+    LoadGenConfig config = defaultLoadGenConfig();
+    if (jsonobj.count("loadgen"))
+        config.maxFrames = jsonobj["loadgen"].value("max_frames", config.maxFrames);
+    FrameCache cache;
+    if (!cache.load(input, config.maxFrames, ingestNV12))
+    {
+        return -1;
+    }
+    string weights = modelLayers.substr(0, modelLayers.rfind(".")) + ".bin";
+
+    std::vector<std::vector<std::vector<Rect> > > detections(resolutions.size());
+    std::vector<double> fps(resolutions.size());
+    for (size_t i = 0; i < resolutions.size(); i++)
+    {
+        Network detector;
+        detector.isAsync = 0;
+        detector.nv12Input = ingestNV12;
+        detector.setInputSize(resolutions[i].width, resolutions[i].height);
+        if (detector.loadNetwork(modelLayers, weights, detector.ie, device) != 0)
+        {
+            return -1;
+        }
+
+        Mat rsImg;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (const Mat &frame : cache.frames)
+        {
+            Size size = frameSize(frame, ingestNV12);
+            if (ingestNV12)
+            {
+                detector.fillInputBlobNV12(frame);
+            }
+            else
+            {
+                cv::resize(frame, rsImg, cv::Size(detector.getModelWidth(), detector.getModelHeight()));
+                detector.fillInputBlob(rsImg);
+            }
+            detector.inferenceRequest();
+            detector.wait();
+            std::vector<Rect> faces;
+            parseFaces(detector, size, faces);
+            detections[i].push_back(faces);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        fps[i] = seconds > 0 ? cache.frames.size() / seconds : 0;
+    }
+
+    const std::vector<std::vector<Rect> > &reference = detections.back();
+    size_t referenceFaces = 0;
+    for (auto const &faces : reference)
+        referenceFaces += faces.size();
+    cout << "Face detection over " << cache.frames.size() << " frames, recall against " << resolutions.back().width << "x"
+         << resolutions.back().height << ":" << endl;
+    for (size_t i = 0; i < resolutions.size(); i++)
+    {
+        size_t found = 0, matched = 0;
+        for (size_t f = 0; f < reference.size(); f++)
+        {
+            found += detections[i][f].size();
+            matched += countMatches(reference[f], detections[i][f]);
+        }
+        cout << resolutions[i].width << "x" << resolutions[i].height << ": " << fps[i] << " fps, "
+             << (double)found / reference.size() << " faces/frame, recall "
+             << (referenceFaces ? (double)matched / referenceFaces : 1.0) << endl;
+    }
+    return 0;
+}
+
+/* runGazeBench replays the cached input through the pipeline with the plain looking test and then with
+   the gaze filter, reporting the head pose inferences each one ran and how often its lookers count changed. */
+int runGazeBench(const string &input, Network &net, Network &net_pose)
+{
+    LoadGenConfig config = defaultLoadGenConfig();
+    if (jsonobj.count("loadgen"))
+        config.maxFrames = jsonobj["loadgen"].value("max_frames", config.maxFrames);
+    FrameCache cache;
+    if (!cache.load(input, config.maxFrames, ingestNV12))
+    {
+        return -1;
+    }
+
+    // Pose results must belong to the frame that was just processed
+    isAsyncmode = false;
+    net.isAsync = 0;
+    net_pose.isAsync = 0;
+
+    GazeFilter filtered = gazeFilter;
+    filtered.enabled = true;
+    cout << "Gaze filter over " << cache.frames.size() << " frames, alpha " << filtered.alpha << ", enter " << filtered.enterDeg
+         << ", exit " << filtered.exitDeg << ", margin " << filtered.marginDeg << ", max skip " << filtered.maxSkip << ":" << endl;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        StreamState state;
+        state.tracker.setGazeFilter(pass == 0 ? defaultGazeFilter() : filtered);
+        for (const Mat &frame : cache.frames)
+        {
+            state.frameId++;
+            processFrame(net, net_pose, state, frame);
+        }
+        printGazeStats(pass == 0 ? "plain" : "filtered", state);
+    }
+    return 0;
+}
+
+/* runPreprocessBench times the head pose preprocessing of face sized regions of the first input frame,
+   comparing crop, cv::resize and interleaved to planar copy against the fused fillInputSlot kernel. */
+int runPreprocessBench(const string &input, Network &net_pose)
+{
+    VideoCapture cap;
+    Mat frame;
+    if (!openVideoSource(cap, input, false) || !cap.read(frame))
+    {
+        cout << "Could not read a frame from " << input << endl;
+        return -1;
+    }
+
+    const int iterations = 2000;
+    const int sides[] = {32, 64, 128, 256};
+    Mat rsImg_pose;
+    for (int side : sides)
+    {
+        side = std::min(side, std::min(frame.cols, frame.rows));
+        Rect r((frame.cols - side) / 2, (frame.rows - side) / 2, side, side);
+
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < iterations; i++)
+        {
+            cv::resize(frame(r), rsImg_pose, cv::Size(net_pose.getModelWidth(), net_pose.getModelHeight()));
+            net_pose.fillInputBlob(rsImg_pose);
+        }
+        std::chrono::high_resolution_clock::time_point mid = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < iterations; i++)
+        {
+            net_pose.fillInputSlot(frame, r, 0);
+        }
+        std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+
+        double split = std::chrono::duration<double, std::micro>(mid - start).count() / iterations;
+        double fused = std::chrono::duration<double, std::micro>(end - mid).count() / iterations;
+        cout << side << "x" << side << " face: resize+copy " << split << " us, fused " << fused
+             << " us (" << split / fused << "x)" << endl;
+    }
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
     // Parse command parameters
@@ -336,6 +1059,69 @@ int main(int argc, char **argv)
         myTargetDevice = "CPU";
     }
 
+    // Thread placement must be known before the plugin creates its threads
+    if (jsonobj.count("placement"))
+    {
+        json p = jsonobj["placement"];
+        if (!parseCpuSet(p.value("capture", ""), placement.capture) ||
+            !parseCpuSet(p.value("inference", ""), placement.inference) ||
+            !parseCpuSet(p.value("messaging", ""), placement.messaging))
+        {
+            std::cout << "Invalid thread placement in " << conf_file << std::endl;
+            return EXIT_FAILURE;
+        }
+        placement.pluginBind = p.value("plugin_bind", "");
+        placement.pluginThreads = p.value("plugin_threads", 0);
+
+        std::map<std::string, std::string> pluginConfig = pluginPlacementConfig(placement.pluginBind);
+        if (!pluginConfig.empty() && myTargetDevice.find("CPU") != std::string::npos)
+            net.ie.SetConfig(pluginConfig, "CPU");
+
+        std::cout << "Capture on CPUs " << describeCpuSet(placement.capture)
+                  << ", inference on CPUs " << describeCpuSet(placement.inference);
+        if (!placement.inference.empty())
+            std::cout << " (NUMA node " << numaNodeOfCpu(placement.inference[0]) << ")";
+        std::cout << ", messaging on CPUs " << describeCpuSet(placement.messaging) << std::endl;
+    }
+
+    // NV12 frames are converted and resized by the plugin, so the face network must know before loading
+    ingestNV12 = parser.has("nv12");
+    net.nv12Input = ingestNV12;
+    showDisplay = !parser.has("nodisplay");
+
+    // The face detector is reshaped when it is loaded, either to one resolution or, in auto mode,
+    // to the largest of face_resolutions with one more copy for each of the smaller ones
+    std::vector<cv::Size> resolutions = configResolutions();
+    string faceRes = parser.get<cv::String>("faceres");
+    if (faceRes.empty() && jsonobj["inputs"][0].count("face_resolution"))
+        faceRes = jsonobj["inputs"][0]["face_resolution"].get<string>();
+    bool autoResolution = faceRes == "auto";
+    if (autoResolution)
+    {
+        if (resolutions.size() < 2)
+        {
+            std::cout << "Automatic face resolution needs at least two face_resolutions in the config file.\n";
+            return EXIT_FAILURE;
+        }
+        if (parser.has("loadgen") || parser.has("placementbench"))
+        {
+            // Workers would share the per-resolution detectors, so the load generator needs a fixed resolution
+            std::cout << "Automatic face resolution is not supported by the load generator, please give -fr a fixed size.\n";
+            return EXIT_FAILURE;
+        }
+        net.setInputSize(resolutions.back().width, resolutions.back().height);
+    }
+    else if (!faceRes.empty())
+    {
+        cv::Size fixed;
+        if (!parseResolution(faceRes, fixed))
+        {
+            std::cout << "Face resolution must be WIDTHxHEIGHT or auto, got " << faceRes << "\n";
+            return EXIT_FAILURE;
+        }
+        net.setInputSize(fixed.width, fixed.height);
+    }
+
     if (parser.has("model"))
     {
         conf_modelLayers = parser.get<cv::String>("model");
@@ -358,6 +1144,7 @@ int main(int argc, char **argv)
 
     if (parser.has("posemodel"))
     {
+        net_pose.setBatchSize(std::max(1, parser.get<int>("posebatch")));
         conf_modelLayers_pose = parser.get<cv::String>("posemodel");
         int pos = conf_modelLayers_pose.rfind(".");
         conf_modelWeights_pose = conf_modelLayers_pose.substr(0, pos) + ".bin";
@@ -392,9 +1179,119 @@ int main(int argc, char **argv)
          net.isAsync = 1;
          net_pose.isAsync = 1;
     }
+    // Head pose results update the track of each face, so they must come from the request that was
+    // just run rather than the previous one: only face detection runs in async mode
+    net_pose.isAsync = 0;
+    if (autoResolution)
+    {
+        // Results must come from the network that ran the frame, so switching runs face detection in sync mode
+        net.isAsync = 0;
+        faceNets.resize(resolutions.size() - 1);
+        for (size_t i = 0; i < faceNets.size(); i++)
+        {
+            faceNets[i].isAsync = 0;
+            faceNets[i].nv12Input = ingestNV12;
+            faceNets[i].setInputSize(resolutions[i].width, resolutions[i].height);
+            if (faceNets[i].loadNetwork(conf_modelLayers, conf_modelWeights, net.ie, myTargetDevice) != 0)
+                return EXIT_FAILURE;
+        }
+        faceResolution.configure(resolutions, jsonobj.value("min_face_px", 24), jsonobj.value("probe_interval", 30));
+        std::cout << "Face detection switches between " << resolutions.size() << " resolutions in sync mode" << endl;
+    }
     rate = parser.get<int>("rate");
+    if (parser.get<int>("batchbytes") <= 0 || parser.get<int>("batchms") <= 0)
+    {
+        std::cout << "Please set a positive telemetry batch size and batch time.\n";
+        return EXIT_FAILURE;
+    }
+    poseBudget.configure(parser.get<double>("budget"));
+    json gaze = jsonobj.count("gaze") ? jsonobj["gaze"] : json::object();
+    gazeFilter.enabled = parser.has("gazefilter");
+    gazeFilter.alpha = gaze.value("alpha", 0.5);
+    gazeFilter.enterDeg = gaze.value("enter_deg", 20.0);
+    gazeFilter.exitDeg = gaze.value("exit_deg", 25.0);
+    gazeFilter.marginDeg = gaze.value("margin_deg", 8.0);
+    gazeFilter.maxSkip = gaze.value("max_skip", 5);
+    if (!(gazeFilter.alpha > 0 && gazeFilter.alpha <= 1) || !(gazeFilter.enterDeg <= gazeFilter.exitDeg) ||
+        !(gazeFilter.marginDeg >= 0) || gazeFilter.maxSkip < 0)
+    {
+        std::cout << "Please set a gaze alpha in (0, 1], an enter_deg no larger than exit_deg, and a non-negative margin_deg and max_skip.\n";
+        return EXIT_FAILURE;
+    }
     auto obj = jsonobj["inputs"];
     input = obj[0]["video"];
+    if (obj[0].count("shelf"))
+    {
+        json shelf = obj[0]["shelf"];
+        HeatmapConfig hm;
+        hm.cols = shelf.value("cols", 32);
+        hm.rows = shelf.value("rows", 16);
+        hm.distance = shelf.value("distance", 0.5);
+        hm.halfLife = shelf.value("half_life", 300.0);
+        hm.interval = shelf.value("interval", 10);
+        if (!heatmap.configure(hm))
+        {
+            std::cout << "Please set cols and rows of at least 1 and a positive half_life for the shelf.\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Record per-frame pipeline timelines
+    tracePath = parser.get<cv::String>("trace");
+    if (!tracePath.empty())
+    {
+        traceStart(parser.get<int>("tracesize"));
+        traceThreadName("capture");
+        signal(SIGUSR1, handleTraceSignal);
+    }
+
+    if (parser.has("loadgen") || parser.has("placementbench"))
+    {
+        int rc = runLoadGenerator(input, net, net_pose, conf_modelLayers, conf_modelLayers_pose, myTargetDevice, parser.has("placementbench"));
+        if (!tracePath.empty())
+            traceDump(tracePath);
+        return rc == 0 ? 0 : EXIT_FAILURE;
+    }
+
+    if (parser.has("resbench"))
+    {
+        if (resolutions.empty())
+        {
+            std::cout << "Please list the face_resolutions to compare in the config file.\n";
+            return EXIT_FAILURE;
+        }
+        return runResolutionBench(input, conf_modelLayers, myTargetDevice, resolutions) == 0 ? 0 : EXIT_FAILURE;
+    }
+
+    if (parser.has("abtest"))
+    {
+        ABConfig ab = defaultABConfig();
+        ab.faceA = conf_modelLayers;
+        ab.poseA = conf_modelLayers_pose;
+        ab.faceB = parser.has("modelb") ? parser.get<cv::String>("modelb") : conf_modelLayers;
+        ab.poseB = parser.has("posemodelb") ? parser.get<cv::String>("posemodelb") : conf_modelLayers_pose;
+        ab.device = myTargetDevice;
+        ab.nv12 = ingestNV12;
+        if (jsonobj.count("abtest"))
+        {
+            json limits = jsonobj["abtest"];
+            ab.maxFrames = limits.value("max_frames", ab.maxFrames);
+            ab.minIou = limits.value("min_iou", ab.minIou);
+            ab.minCountAgreement = limits.value("min_count_agreement", ab.minCountAgreement);
+            ab.maxAngleError = limits.value("max_angle_error", ab.maxAngleError);
+        }
+        return runPrecisionAB(input, ab) == 0 ? 0 : EXIT_FAILURE;
+    }
+
+    if (parser.has("preprocbench"))
+    {
+        return runPreprocessBench(input, net_pose) == 0 ? 0 : EXIT_FAILURE;
+    }
+
+    if (parser.has("gazebench"))
+    {
+        return runGazeBench(input, net, net_pose) == 0 ? 0 : EXIT_FAILURE;
+    }
 
     // Connect MQTT messaging
     int result = mqtt_start(handleMQTTControlMessages);
@@ -409,30 +1306,145 @@ int main(int argc, char **argv)
 
     mqtt_connect();
 
-    if (input.size() == 1 && *(input.c_str()) >= '0' && *(input.c_str()) <= '9')
-        cap.open(std::stoi(input));
-    else
-        cap.open(input);
+    // The outbox and telemetry threads inherit the affinity of the thread that starts them
+    std::vector<int> original = currentThreadCpus();
+    pinCurrentThread(placement.messaging);
 
-    if (!cap.isOpened())
+    // Buffer outgoing messages so they survive broker outages and restarts
+    string outboxPath = parser.get<cv::String>("outbox");
+    if (!outboxPath.empty() && outbox.open(outboxPath, (size_t)parser.get<int>("outboxsize") << 20))
     {
-        cerr << "ERROR! Unable to open video source\n";
-        return -1;
+        outbox.start(mqtt_publish_batch, []() { return mqtt_is_connected() || mqtt_connect() == 0; });
+    }
+
+    // Stream per-frame counts and per-track events in batches
+    string telemetryMode = parser.get<cv::String>("telemetry");
+    if (telemetryMode == "json" || telemetryMode == "binary")
+    {
+        telemetry.start(telemetryMode == "json" ? TelemetryJSON : TelemetryBinary, parser.has("compress"),
+                        parser.get<int>("batchbytes"), parser.get<int>("batchms"),
+                        [](const string &payload) { sendMQTTMessage("retail/events", payload); });
+    }
+    pinCurrentThread(original);
+
+    // An external decoder process can publish frames into a shared memory ring instead
+    bool shmInput = input.compare(0, 4, "shm:") == 0;
+    std::vector<Mat> framePool;
+    if (shmInput)
+    {
+        if (!shmSource.open(input.substr(4)))
+        {
+            cerr << "ERROR! Unable to open video source\n";
+            return -1;
+        }
+        if (shmSource.isNV12() != ingestNV12)
+        {
+            cerr << "ERROR! " << input << (ingestNV12 ? " carries BGR frames, run without -nv12\n" : " carries NV12 frames, run with -nv12\n");
+            return -1;
+        }
+
+        // Reads wait for the producer, so there is no playback rate to keep
+        delay = 1;
     }
+    else
+    {
+        if (!openVideoSource(cap, input, ingestNV12))
+        {
+            cerr << "ERROR! Unable to open video source\n";
+            return -1;
+        }
+
+        // Also adjust delay so video playback matches the number of FPS in the file
+        double fps = cap.get(CAP_PROP_FPS);
+        delay = 1000 / fps;
 
-    // Also adjust delay so video playback matches the number of FPS in the file
-    double fps = cap.get(CAP_PROP_FPS);
-    delay = 1000 / fps;
+        // Allocate the frame buffers from the inference CPUs, so first touch places them on the node that reads them
+        pinCurrentThread(placement.inference);
+        for (int i = 0; i < framePoolSize; i++)
+        {
+            int rows = (int)cap.get(CAP_PROP_FRAME_HEIGHT);
+            int cols = (int)cap.get(CAP_PROP_FRAME_WIDTH);
+            if (ingestNV12)
+                framePool.push_back(Mat(rows * 3 / 2, cols, CV_8UC1, Scalar(0)));
+            else
+                framePool.push_back(Mat(rows, cols, CV_8UC3, Scalar(0, 0, 0)));
+        }
+        pinCurrentThread(original);
+    }
+
+    // A soak run loops the input and stops the pipeline when it is over
+    bool soak = parser.has("soak");
+    if (soak)
+    {
+        SoakConfig sc = defaultSoakConfig();
+        if (jsonobj.count("soak"))
+        {
+            json j = jsonobj["soak"];
+            sc.csvPath = j.value("csv", sc.csvPath);
+            sc.interval = j.value("interval", sc.interval);
+            sc.hours = j.value("hours", sc.hours);
+            sc.warmup = j.value("warmup", sc.warmup);
+            sc.maxRssGrowth = j.value("max_rss_growth", sc.maxRssGrowth);
+            sc.maxP99Growth = j.value("max_p99_growth", sc.maxP99Growth);
+            sc.driftSamples = j.value("drift_samples", sc.driftSamples);
+        }
+        SoakQueueProbe probe = []() {
+            SoakQueues q;
+            m.lock();
+            q.frames = nextImage.size();
+            m.unlock();
+            q.outbox = outbox.isOpen() ? outbox.getStats().pending : 0;
+            q.telemetry = telemetry.isRunning() ? telemetry.getStats().queued : 0;
+            return q;
+        };
+        if (!soakStart(sc, probe, []() { keepRunning = false; }))
+            return EXIT_FAILURE;
+        cout << "Soak run for " << sc.hours << " hours, sampling every " << sc.interval << " seconds into " << sc.csvPath << endl;
+    }
 
     // Start worker threads
-    std::thread t1(frameRunner, net, net_pose);
+    std::thread t1(frameRunner, std::ref(net), std::ref(net_pose));
     std::thread t2(messageRunner);
 
+    // Pin capture only now, so that threads started above do not inherit its CPUs
+    pinCurrentThread(placement.capture);
+
     // Read video input data
-    for (;;)
+    for (uint64_t frameId = 1; keepRunning.load(); frameId++)
     {
-        cap.read(frame);
+        std::chrono::steady_clock::time_point captureStart = std::chrono::steady_clock::now();
+        traceBegin("capture", frameId);
+        frame.release();
+        if (shmInput)
+        {
+            // The frame is mapped from the ring, and its sequence number becomes the frame id
+            uint64_t seq;
+            if (shmSource.read(frame, seq, 1000))
+                frameId = seq;
+        }
+        else
+        {
+            frame = nextFrameBuffer(framePool);
+            cap.read(frame);
+            if (frame.empty() && soak)
+            {
+                // Start the clip over, keeping the frame ids counting up
+                cap.release();
+                if (openVideoSource(cap, input, ingestNV12))
+                {
+                    frame = nextFrameBuffer(framePool);
+                    cap.read(frame);
+                }
+            }
+        }
+        traceEnd("capture", frameId);
+        soakRecord(SoakCapture, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - captureStart).count());
 
+        if (frame.empty() && shmInput && keepRunning.load())
+        {
+            cerr << "Waiting for frames from " << input << endl;
+            continue;
+        }
         if (frame.empty())
         {
             cerr << "ERROR! blank frame grabbed\n";
@@ -440,16 +1452,38 @@ int main(int argc, char **argv)
             break;
         }
 
-        addImage(frame);
+        // Only the displayed frame is converted to BGR in NV12 mode. A frame in the ring goes back to
+        // the producer once inference releases it, so it is copied for display before it is queued.
+        Mat display = frame;
+        if (showDisplay && ingestNV12)
+            cvtColor(frame, display, COLOR_YUV2BGR_NV12);
+        else if (showDisplay && shmInput)
+            display = frame.clone();
+
+        addImage(frame, frameId);
+
+        if (!showDisplay)
+        {
+            if (!shmInput)
+                std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+            continue;
+        }
 
         string label = getCurrentPerf();
-        putText(frame, label, Point(0, 15), FONT_HERSHEY_SIMPLEX, 0.5, Scalar(0, 0, 0));
+        putText(display, label, Point(0, 15), FONT_HERSHEY_SIMPLEX, 0.5, Scalar(0, 0, 0));
 
         ShoppingInfo info = getCurrentInfo();
         label = format("Shoppers: %d, lookers: %d", info.shoppers, info.lookers);
-        putText(frame, label, Point(0, 40), FONT_HERSHEY_SIMPLEX, 0.5, Scalar(0, 0, 0));
+        putText(display, label, Point(0, 40), FONT_HERSHEY_SIMPLEX, 0.5, Scalar(0, 0, 0));
+
+        if (outbox.isOpen())
+        {
+            OutboxStats stats = outbox.getStats();
+            label = format("MQTT backlog: %llu, replay: %.1f msg/s", (unsigned long long)stats.pending, stats.replayRate);
+            putText(display, label, Point(0, 65), FONT_HERSHEY_SIMPLEX, 0.5, Scalar(0, 0, 0));
+        }
 
-        imshow("Shopper Gaze Monitor", frame);
+        imshow("Shopper Gaze Monitor", display);
 
         // TODO: signal threads to exit
         if (waitKey(delay) >= 0)
@@ -463,13 +1497,40 @@ int main(int argc, char **argv)
     // TODO: wait for worker threads to exit
     t1.join();
     t2.join();
+    bool soakPassed = soakStop();
+
+    if (poseBudget.isEnabled())
+    {
+        cout << "Latency budget: " << budgetStatsMessage() << endl;
+    }
+
+    if (shmSource.isOpen())
+    {
+        cout << "Shared memory input: " << shmSource.frames() << " frames read, " << shmSource.skipped() << " skipped, "
+             << shmSource.dropped() << " dropped by the producer" << endl;
+        shmSource.close();
+    }
+
+    if (!tracePath.empty())
+    {
+        traceDump(tracePath);
+    }
 
     // Disconnect MQTT messaging
+    if (telemetry.isRunning())
+    {
+        telemetry.stop();
+        TelemetryStats stats = telemetry.getStats();
+        cout << "Telemetry: " << stats.events << " events in " << stats.messages << " messages, "
+             << (stats.events ? (double)stats.bytes / stats.events : 0) << " bytes per event, "
+             << (stats.seconds > 0 ? stats.messages / stats.seconds : 0) << " messages per second" << endl;
+    }
+    outbox.stop();
     mqtt_disconnect();
     mqtt_close();
 
     destroyAllWindows();
     cap.release();
 
-    return 0;
+    return soakPassed ? 0 : EXIT_FAILURE;
 }
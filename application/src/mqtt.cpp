@@ -26,9 +26,8 @@
 bool mqtt_initialized = false;
 MQTTClient client;
 MQTTClient_connectOptions conn_opts = MQTTClient_connectOptions_initializer;
-MQTTClient_message pubmsg = MQTTClient_message_initializer;
-MQTTClient_deliveryToken token;
 MQTTClient_SSLOptions sslOptions = MQTTClient_SSLOptions_initializer;
+mqtt_service_config mqtt_credentials;
 
 std::string std_getenv(const std::string &name)
 {
@@ -61,42 +60,24 @@ void mqtt_init(mqtt_service_config const &config)
     conn_opts.keepAliveInterval = 20;
     conn_opts.cleansession = 1;
 
+    // The options keep pointers to these strings, which are used again on every reconnect
+    mqtt_credentials = config;
     if (!config.username.empty())
     {
-        std::vector<char> username_c(
-            config.username.c_str(),
-            config.username.c_str() + config.username.size() + 1);
-
-        conn_opts.username = &username_c[0];
+        conn_opts.username = mqtt_credentials.username.c_str();
     }
 
     if (!config.password.empty())
     {
-        std::vector<char> password_c(
-            config.password.c_str(),
-            config.password.c_str() + config.password.size() + 1);
-
-        conn_opts.password = &password_c[0];
+        conn_opts.password = mqtt_credentials.password.c_str();
     }
 
     // ssl options
     if (!config.cert.empty() && !config.cert_key.empty() && !config.ca_root.empty())
     {
-        std::vector<char> cert_c(
-            config.cert.c_str(),
-            config.cert.c_str() + config.cert.size() + 1);
-
-        std::vector<char> cert_key_c(
-            config.cert_key.c_str(),
-            config.cert_key.c_str() + config.cert_key.size() + 1);
-
-        std::vector<char> ca_root_c(
-            config.ca_root.c_str(),
-            config.ca_root.c_str() + config.ca_root.size() + 1);
-
-        sslOptions.keyStore = &cert_c[0];
-        sslOptions.privateKey = &cert_key_c[0];
-        sslOptions.trustStore = &ca_root_c[0];
+        sslOptions.keyStore = mqtt_credentials.cert.c_str();
+        sslOptions.privateKey = mqtt_credentials.cert_key.c_str();
+        sslOptions.trustStore = mqtt_credentials.ca_root.c_str();
     }
     else
     {
@@ -134,16 +115,19 @@ void mqtt_close()
     }
 };
 
-void mqtt_connect()
+int mqtt_connect()
 {
-    if (mqtt_initialized)
+    if (!mqtt_initialized)
     {
-        int rc;
-        if ((rc = MQTTClient_connect(client, &conn_opts)) != MQTTCLIENT_SUCCESS)
-        {
-            return;
-        }
+        return -1;
     }
+
+    return MQTTClient_connect(client, &conn_opts);
+}
+
+bool mqtt_is_connected()
+{
+    return mqtt_initialized && MQTTClient_isConnected(client);
 }
 
 void mqtt_disconnect()
@@ -169,8 +153,11 @@ int mqtt_publish(std::string const &topic, std::string const &message)
         message.c_str(),
         message.c_str() + message.size() + 1);
 
+    // The message and token are local, as the telemetry and messaging threads may publish at the same time
+    MQTTClient_message pubmsg = MQTTClient_message_initializer;
+    MQTTClient_deliveryToken token;
     pubmsg.payload = &message_c[0];
-    pubmsg.payloadlen = strlen(&message_c[0]);
+    pubmsg.payloadlen = message.size();
     pubmsg.qos = QOS;
     pubmsg.retained = 0;
     int result = MQTTClient_publishMessage(client, &topic_c[0], &pubmsg, &token);
@@ -181,6 +168,43 @@ int mqtt_publish(std::string const &topic, std::string const &message)
     return MQTTClient_waitForCompletion(client, token, TIMEOUT);
 }
 
+/* mqtt_publish_batch publishes the messages back to back and then waits for their delivery,
+   returning how many of them, counted from the first, were delivered.*/
+size_t mqtt_publish_batch(std::vector<std::pair<std::string, std::string> > const &messages)
+{
+    if (!mqtt_initialized)
+    {
+        return 0;
+    }
+
+    std::vector<MQTTClient_deliveryToken> tokens;
+    for (auto const &m : messages)
+    {
+        MQTTClient_message msg = MQTTClient_message_initializer;
+        msg.payload = const_cast<char *>(m.second.data());
+        msg.payloadlen = m.second.size();
+        msg.qos = QOS;
+        msg.retained = 0;
+        MQTTClient_deliveryToken t;
+        if (MQTTClient_publishMessage(client, m.first.c_str(), &msg, &t) != MQTTCLIENT_SUCCESS)
+        {
+            break;
+        }
+        tokens.push_back(t);
+    }
+
+    size_t delivered = 0;
+    for (auto t : tokens)
+    {
+        if (MQTTClient_waitForCompletion(client, t, TIMEOUT) != MQTTCLIENT_SUCCESS)
+        {
+            break;
+        }
+        delivered++;
+    }
+    return delivered;
+}
+
 void mqtt_subscribe(std::string const &topic)
 {
     if (!mqtt_initialized)
@@ -0,0 +1,498 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "outbox.hpp"
+#include "trace.hpp"
+
+static const uint32_t outboxMagic = 0x584f4253; // "SBOX"
+static const uint32_t outboxVersion = 1;
+static const size_t outboxHeaderSize = 4096;
+static const size_t outboxMinCapacity = 64 * 1024;
+static const size_t outboxBatchSize = 10;       // paho's default limit of in-flight QoS 1 messages
+static const int outboxFlushIntervalMs = 1000;
+static const int outboxMaxBackoffSec = 30;
+static const uint16_t recordPad = 1;
+
+// OutboxIndex is one copy of the ring indexes. The copy with a valid CRC and the highest generation wins.
+struct OutboxIndex
+{
+    uint64_t generation;
+    uint64_t head;
+    uint64_t tail;
+    uint32_t crc;
+    uint32_t reserved;
+};
+
+// OutboxHeader is stored in the first page of the outbox file.
+struct OutboxHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    OutboxIndex index[2];
+};
+
+// OutboxRecord precedes every message in the ring. A record never wraps around the end of the ring.
+struct OutboxRecord
+{
+    uint32_t size;     // topic plus payload bytes
+    uint32_t crc;      // CRC-32 of the topic and payload
+    uint16_t topicLen;
+    uint16_t flags;
+    uint32_t reserved;
+};
+
+// crc32 computes the standard CRC-32 (IEEE 802.3) of a buffer.
+static uint32_t crc32(const uint8_t *data, size_t len)
+{
+    struct Table
+    {
+        uint32_t v[256];
+        Table()
+        {
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++)
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                v[i] = c;
+            }
+        }
+    };
+    static const Table table;
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; i++)
+        crc = table.v[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+static uint32_t indexCrc(const OutboxIndex &idx)
+{
+    return crc32(reinterpret_cast<const uint8_t *>(&idx), offsetof(OutboxIndex, crc));
+}
+
+static uint64_t recordSpan(size_t size)
+{
+    return (sizeof(OutboxRecord) + size + 7) & ~(uint64_t)7;
+}
+
+Outbox::Outbox()
+{
+    fd = -1;
+    base = NULL;
+    ring = NULL;
+    capacity = 0;
+    head = 0;
+    tail = 0;
+    generation = 0;
+    pending = 0;
+    dropped = 0;
+    replayed = 0;
+    replayRate = 0;
+    dirty = false;
+    running = false;
+}
+
+Outbox::~Outbox()
+{
+    stop();
+    if (base)
+    {
+        msync(base, outboxHeaderSize + capacity, MS_SYNC);
+        munmap(base, outboxHeaderSize + capacity);
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+/* open maps the outbox file, creating it with the given capacity in bytes if needed.
+   An existing outbox keeps its own capacity so pending messages survive a configuration change.*/
+bool Outbox::open(const std::string &path, size_t requested)
+{
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        std::cout << "Unable to open MQTT outbox " << path << std::endl;
+        return false;
+    }
+
+    OutboxHeader existing;
+    bool valid = pread(fd, &existing, sizeof(existing), 0) == (ssize_t)sizeof(existing) &&
+                 existing.magic == outboxMagic && existing.version == outboxVersion &&
+                 existing.capacity >= outboxMinCapacity && existing.capacity % 8 == 0;
+    capacity = valid ? existing.capacity : (std::max(requested, outboxMinCapacity) + 7) & ~(size_t)7;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size != outboxHeaderSize + capacity)
+    {
+        if (ftruncate(fd, outboxHeaderSize + capacity) != 0)
+        {
+            std::cout << "Unable to size MQTT outbox " << path << std::endl;
+            close(fd);
+            fd = -1;
+            return false;
+        }
+    }
+
+    void *mem = mmap(NULL, outboxHeaderSize + capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (mem == MAP_FAILED)
+    {
+        std::cout << "Unable to map MQTT outbox " << path << std::endl;
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    base = static_cast<uint8_t *>(mem);
+    ring = base + outboxHeaderSize;
+
+    OutboxHeader *header = reinterpret_cast<OutboxHeader *>(base);
+    if (!valid)
+    {
+        memset(header, 0, sizeof(*header));
+        header->magic = outboxMagic;
+        header->version = outboxVersion;
+        header->capacity = capacity;
+    }
+    recover();
+    writeIndex();
+
+    if (pending > 0)
+    {
+        std::cout << "MQTT outbox recovered " << pending << " pending messages" << std::endl;
+    }
+    return true;
+}
+
+bool Outbox::isOpen() const
+{
+    return base != NULL;
+}
+
+/* recover restores the newest valid ring indexes and drops any torn records at the head,
+   reporting how much was dropped.*/
+void Outbox::recover()
+{
+    OutboxHeader *header = reinterpret_cast<OutboxHeader *>(base);
+    const OutboxIndex *best = NULL;
+    for (int i = 0; i < 2; i++)
+    {
+        const OutboxIndex &idx = header->index[i];
+        if (idx.crc == indexCrc(idx) && idx.tail <= idx.head && idx.head - idx.tail <= capacity &&
+            (best == NULL || idx.generation > best->generation))
+        {
+            best = &idx;
+        }
+    }
+
+    head = best ? best->head : 0;
+    tail = best ? best->tail : 0;
+    generation = best ? best->generation : 0;
+    pending = 0;
+
+    uint64_t pos = tail;
+    uint64_t next;
+    while (pos < head && readRecord(pos, NULL, &next))
+    {
+        pending++;
+        pos = next;
+    }
+
+    // Everything from the first record that fails its check is dropped, as record boundaries past it are unknown
+    if (pos < head)
+    {
+        std::cout << "MQTT outbox discarded " << head - pos << " bytes of unreadable records after " << pending
+                  << " valid messages" << std::endl;
+    }
+    head = pos;
+}
+
+// writeIndex stores the current indexes into the older of the two index slots.
+void Outbox::writeIndex()
+{
+    OutboxHeader *header = reinterpret_cast<OutboxHeader *>(base);
+    generation++;
+    OutboxIndex &idx = header->index[generation & 1];
+    idx.generation = generation;
+    idx.head = head;
+    idx.tail = tail;
+    idx.reserved = 0;
+    idx.crc = indexCrc(idx);
+    dirty = true;
+}
+
+// nextRecord returns the position following the record at pos, skipping any padding before it.
+uint64_t Outbox::nextRecord(uint64_t pos) const
+{
+    uint64_t phys = pos % capacity;
+    uint64_t rem = capacity - phys;
+    const OutboxRecord *r = reinterpret_cast<const OutboxRecord *>(ring + phys);
+    if (rem < sizeof(OutboxRecord) || (r->flags & recordPad))
+    {
+        return nextRecord(pos + rem);
+    }
+    return pos + recordSpan(r->size);
+}
+
+// readRecord validates the record at pos and optionally copies it out.
+bool Outbox::readRecord(uint64_t pos, OutboxMessage *msg, uint64_t *next) const
+{
+    uint64_t phys = pos % capacity;
+    uint64_t rem = capacity - phys;
+    const OutboxRecord *r = reinterpret_cast<const OutboxRecord *>(ring + phys);
+    if (rem < sizeof(OutboxRecord) || (r->flags & recordPad))
+    {
+        return pos + rem < head && readRecord(pos + rem, msg, next);
+    }
+
+    const uint8_t *data = ring + phys + sizeof(OutboxRecord);
+    if (r->size > rem - sizeof(OutboxRecord) || r->topicLen > r->size ||
+        pos + recordSpan(r->size) > head || r->crc != crc32(data, r->size))
+    {
+        return false;
+    }
+
+    if (msg)
+    {
+        msg->first.assign(reinterpret_cast<const char *>(data), r->topicLen);
+        msg->second.assign(reinterpret_cast<const char *>(data) + r->topicLen, r->size - r->topicLen);
+    }
+    *next = pos + recordSpan(r->size);
+    return true;
+}
+
+/* push appends a message to the ring. When the ring is full the oldest messages are dropped.
+   Only memory is touched here; the flusher thread writes the pages back to disk.*/
+void Outbox::push(const std::string &topic, const std::string &payload)
+{
+    if (!isOpen())
+    {
+        return;
+    }
+
+    size_t size = topic.size() + payload.size();
+    uint64_t span = recordSpan(size);
+    std::lock_guard<std::mutex> guard(lock);
+    if (topic.size() > UINT16_MAX || span > capacity / 2)
+    {
+        dropped++;
+        return;
+    }
+
+    uint64_t rem = capacity - head % capacity;
+    uint64_t padding = rem < span ? rem : 0;
+    while (pending > 0 && head + padding + span - tail > capacity)
+    {
+        tail = nextRecord(tail);
+        pending--;
+        dropped++;
+    }
+    if (pending == 0)
+    {
+        tail = head;
+    }
+
+    if (padding > 0)
+    {
+        if (padding >= sizeof(OutboxRecord))
+        {
+            OutboxRecord *pad = reinterpret_cast<OutboxRecord *>(ring + head % capacity);
+            memset(pad, 0, sizeof(*pad));
+            pad->flags = recordPad;
+        }
+        head += padding;
+    }
+
+    uint8_t *dst = ring + head % capacity;
+    memcpy(dst + sizeof(OutboxRecord), topic.data(), topic.size());
+    memcpy(dst + sizeof(OutboxRecord) + topic.size(), payload.data(), payload.size());
+    OutboxRecord *r = reinterpret_cast<OutboxRecord *>(dst);
+    r->size = size;
+    r->crc = crc32(dst + sizeof(OutboxRecord), size);
+    r->topicLen = topic.size();
+    r->flags = 0;
+    r->reserved = 0;
+
+    head += span;
+    pending++;
+    writeIndex();
+    available.notify_all();
+}
+
+// start launches the drain and flusher threads.
+void Outbox::start(OutboxPublisher pub, OutboxReconnect recon)
+{
+    if (!isOpen() || running.load())
+    {
+        return;
+    }
+    publisher = pub;
+    reconnect = recon;
+    running = true;
+    drainThread = std::thread(&Outbox::drainRunner, this);
+    flushThread = std::thread(&Outbox::flushRunner, this);
+}
+
+// stop ends the background threads. Undelivered messages stay in the file for the next run.
+void Outbox::stop()
+{
+    if (!running.exchange(false))
+    {
+        return;
+    }
+    available.notify_all();
+    drainThread.join();
+    flushThread.join();
+}
+
+OutboxStats Outbox::getStats()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    OutboxStats stats;
+    stats.pending = pending;
+    stats.pendingBytes = head - tail;
+    stats.dropped = dropped;
+    stats.replayed = replayed;
+    stats.replayRate = replayRate;
+    return stats;
+}
+
+// drainRunner publishes pending messages in batches, backing off while the broker is unreachable.
+void Outbox::drainRunner()
+{
+    typedef std::chrono::steady_clock clock;
+    int backoff = 1;
+    uint64_t windowCount = 0;
+    clock::time_point windowStart = clock::now();
+    traceThreadName("outbox");
+
+    while (running.load())
+    {
+        std::vector<OutboxMessage> batch;
+        std::vector<uint64_t> ends;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            available.wait_for(guard, std::chrono::seconds(1), [this]() { return pending > 0 || !running.load(); });
+
+            double elapsed = std::chrono::duration<double>(clock::now() - windowStart).count();
+            if (elapsed >= 1.0)
+            {
+                replayRate = windowCount / elapsed;
+                windowCount = 0;
+                windowStart = clock::now();
+            }
+
+            uint64_t pos = tail;
+            while (batch.size() < outboxBatchSize && pos < head)
+            {
+                OutboxMessage msg;
+                uint64_t next;
+                if (!readRecord(pos, &msg, &next))
+                {
+                    // Unreadable records can only come from corruption, so skip them rather than stall forever
+                    std::cout << "MQTT outbox dropped " << pending - batch.size() << " corrupt messages" << std::endl;
+                    dropped += pending - batch.size();
+                    pending = batch.size();
+                    head = pos;
+                    writeIndex();
+                    break;
+                }
+                batch.push_back(msg);
+                ends.push_back(next);
+                pos = next;
+            }
+        }
+        if (batch.empty())
+        {
+            continue;
+        }
+
+        traceBegin("outbox publish", 0, batch.size());
+        size_t delivered = publisher(batch);
+        traceEnd("outbox publish", 0, batch.size());
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            for (size_t i = 0; i < delivered; i++)
+            {
+                // push may have dropped some of these while they were being published
+                if (ends[i] > tail)
+                {
+                    pending--;
+                }
+            }
+            if (delivered > 0 && ends[delivered - 1] > tail)
+            {
+                tail = ends[delivered - 1];
+                writeIndex();
+            }
+            replayed += delivered;
+            windowCount += delivered;
+        }
+
+        if (delivered < batch.size())
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            available.wait_for(guard, std::chrono::seconds(backoff), [this]() { return !running.load(); });
+            guard.unlock();
+            backoff = std::min(backoff * 2, outboxMaxBackoffSec);
+            if (running.load())
+            {
+                reconnect();
+            }
+        }
+        else
+        {
+            backoff = 1;
+        }
+    }
+}
+
+// flushRunner periodically writes the dirty pages of the mapping back to disk.
+void Outbox::flushRunner()
+{
+    while (running.load())
+    {
+        bool flush;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            available.wait_for(guard, std::chrono::milliseconds(outboxFlushIntervalMs), [this]() { return !running.load(); });
+            flush = dirty;
+            dirty = false;
+        }
+        if (flush)
+        {
+            msync(base, outboxHeaderSize + capacity, MS_SYNC);
+        }
+    }
+}
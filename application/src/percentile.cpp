@@ -0,0 +1,55 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include "percentile.hpp"
+
+// percentile returns the nearest-rank value holding fraction p of a sample, which need not be sorted.
+double percentile(std::vector<double> values, double p)
+{
+    if (values.empty())
+        return 0;
+    size_t rank = (size_t)std::ceil(p * values.size());
+    size_t k = std::min(values.size() - 1, rank > 0 ? rank - 1 : 0);
+    std::nth_element(values.begin(), values.begin() + k, values.end());
+    return values[k];
+}
+
+/* histogramPercentile returns the geometric middle of the bucket holding fraction p of a log-scale
+   histogram with perDoubling buckets per doubling from firstMs. The first bucket also holds
+   everything below firstMs, so it reports half of firstMs.*/
+double histogramPercentile(const uint64_t *counts, int buckets, int perDoubling, double firstMs, uint64_t total, double p)
+{
+    if (total == 0)
+        return 0;
+    uint64_t rank = std::max<uint64_t>(1, (uint64_t)std::ceil(p * total));
+    uint64_t seen = 0;
+    for (int b = 0; b < buckets; b++)
+    {
+        seen += counts[b];
+        if (seen >= rank)
+            return b == 0 ? firstMs / 2 : firstMs * std::pow(2.0, (b + 0.5) / perDoubling);
+    }
+    return firstMs * std::pow(2.0, (double)buckets / perDoubling);
+}
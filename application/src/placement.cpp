@@ -0,0 +1,180 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include "placement.hpp"
+
+// parseCpuNumber parses a whole CPU or node number, rejecting trailing characters such as in "3x".
+static bool parseCpuNumber(const std::string &str, int &value)
+{
+    size_t used = 0;
+    try
+    {
+        value = std::stoi(str, &used);
+    }
+    catch (...)
+    {
+        return false;
+    }
+    return used == str.size();
+}
+
+// parseCpuList parses a kernel style CPU list such as "0-3,8,10-11".
+static bool parseCpuList(const std::string &list, std::vector<int> &cpus)
+{
+    std::istringstream in(list);
+    std::string range;
+    while (std::getline(in, range, ','))
+    {
+        int first, last;
+        size_t dash = range.find('-');
+        if (!parseCpuNumber(range.substr(0, dash), first))
+            return false;
+        last = first;
+        if (dash != std::string::npos && !parseCpuNumber(range.substr(dash + 1), last))
+            return false;
+        if (first < 0 || last < first)
+            return false;
+        for (int c = first; c <= last; c++)
+            cpus.push_back(c);
+    }
+    return true;
+}
+
+/* parseCpuSet resolves a placement such as "0-3,8" or "node:1" into a list of CPUs.
+   Several NUMA nodes can be combined, as in "node:0,1". An empty spec gives an empty list, but a
+   spec that resolves to no CPUs, such as "node:", is an error.*/
+bool parseCpuSet(const std::string &spec, std::vector<int> &cpus)
+{
+    cpus.clear();
+    if (spec.compare(0, 5, "node:") != 0)
+    {
+        return parseCpuList(spec, cpus);
+    }
+
+    std::vector<int> nodes;
+    if (!parseCpuList(spec.substr(5), nodes) || nodes.empty())
+    {
+        return false;
+    }
+    for (int node : nodes)
+    {
+        std::ifstream f("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        std::string list;
+        if (!std::getline(f, list) || !parseCpuList(list, cpus))
+        {
+            std::cout << "Unknown NUMA node " << node << std::endl;
+            return false;
+        }
+    }
+    if (cpus.empty())
+    {
+        std::cout << "NUMA nodes " << spec.substr(5) << " have no CPUs" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// numaNodeOfCpu returns the NUMA node a CPU belongs to, or 0 on systems without NUMA information.
+int numaNodeOfCpu(int cpu)
+{
+    for (int node = 0;; node++)
+    {
+        std::ifstream f("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        std::string list;
+        if (!std::getline(f, list))
+            return 0;
+        std::vector<int> cpus;
+        parseCpuList(list, cpus);
+        for (int c : cpus)
+        {
+            if (c == cpu)
+                return node;
+        }
+    }
+}
+
+// pinCurrentThread restricts the calling thread, and threads it creates afterwards, to the given CPUs.
+bool pinCurrentThread(const std::vector<int> &cpus)
+{
+    if (cpus.empty())
+    {
+        return true;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c : cpus)
+    {
+        if (c < CPU_SETSIZE)
+            CPU_SET(c, &set);
+    }
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+    {
+        std::cout << "Unable to pin thread to CPUs " << describeCpuSet(cpus) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// currentThreadCpus returns the CPUs the calling thread may currently run on.
+std::vector<int> currentThreadCpus()
+{
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0)
+    {
+        for (int c = 0; c < CPU_SETSIZE; c++)
+        {
+            if (CPU_ISSET(c, &set))
+                cpus.push_back(c);
+        }
+    }
+    return cpus;
+}
+
+std::string describeCpuSet(const std::vector<int> &cpus)
+{
+    if (cpus.empty())
+    {
+        return "any";
+    }
+    std::ostringstream out;
+    for (size_t i = 0; i < cpus.size(); i++)
+    {
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1)
+            j++;
+        out << (i ? "," : "") << cpus[i];
+        if (j > i)
+            out << "-" << cpus[j];
+        i = j;
+    }
+    return out.str();
+}
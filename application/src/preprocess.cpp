@@ -0,0 +1,116 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "preprocess.hpp"
+
+static const int coefBits = 11;
+static const int coefScale = 1 << coefBits;
+
+/* computeTaps maps every destination coordinate to its two source neighbours and the weight of
+   the second one, using the same pixel-center alignment as cv::resize with INTER_LINEAR.*/
+static void computeTaps(int srcLen, int dstLen, int pixelSize, int *i0, int *i1, int *w1)
+{
+    float scale = (float)srcLen / dstLen;
+    for (int d = 0; d < dstLen; d++)
+    {
+        float s = (d + 0.5f) * scale - 0.5f;
+        int i = (int)std::floor(s);
+        float f = s - i;
+        if (i < 0)
+        {
+            i = 0;
+            f = 0;
+        }
+        if (i >= srcLen - 1)
+        {
+            i = srcLen - 1;
+            f = 0;
+        }
+        i0[d] = i * pixelSize;
+        i1[d] = std::min(i + 1, srcLen - 1) * pixelSize;
+        w1[d] = (int)(f * coefScale + 0.5f);
+    }
+}
+
+/* bilinearToPlanar resizes a BGR region straight into three planes. FW and FH fix the output
+   size at compile time so the loops can be unrolled; 0 takes the size from width and height.*/
+template <int FW, int FH>
+static void bilinearToPlanar(const uint8_t *src, size_t step, int srcWidth, int srcHeight, uint8_t *dst, int width, int height)
+{
+    const int W = FW ? FW : width;
+    const int H = FH ? FH : height;
+    std::vector<int> dynamicTaps(FW ? 0 : 3 * (W + H));
+    int fixedTaps[FW ? 3 * (FW + FH) : 1];
+    int *taps = FW ? fixedTaps : dynamicTaps.data();
+    int *x0 = taps, *x1 = x0 + W, *wx = x1 + W;
+    int *y0 = wx + W, *y1 = y0 + H, *wy = y1 + H;
+    computeTaps(srcWidth, W, 3, x0, x1, wx);
+    computeTaps(srcHeight, H, 1, y0, y1, wy);
+
+    // Interpolate horizontally into two rows of fixed-point values, then blend them vertically per plane
+    std::vector<int> dynamicRows(FW ? 0 : 6 * W);
+    int fixedRows[FW ? 6 * FW : 1];
+    int *top = FW ? fixedRows : dynamicRows.data();
+    int *bottom = top + 3 * W;
+    const int round = 1 << (2 * coefBits - 1);
+    for (int y = 0; y < H; y++)
+    {
+        const uint8_t *row0 = src + y0[y] * step;
+        const uint8_t *row1 = src + y1[y] * step;
+        for (int c = 0; c < 3; c++)
+        {
+            for (int x = 0; x < W; x++)
+            {
+                int fx = wx[x];
+                top[c * W + x] = row0[x0[x] + c] * (coefScale - fx) + row0[x1[x] + c] * fx;
+                bottom[c * W + x] = row1[x0[x] + c] * (coefScale - fx) + row1[x1[x] + c] * fx;
+            }
+        }
+
+        int fy = wy[y];
+        int iy = coefScale - fy;
+        for (int c = 0; c < 3; c++)
+        {
+            uint8_t *out = dst + c * W * H + y * W;
+            for (int x = 0; x < W; x++)
+            {
+                out[x] = (uint8_t)((top[c * W + x] * iy + bottom[c * W + x] * fy + round) >> (2 * coefBits));
+            }
+        }
+    }
+}
+
+/* cropResizeToPlanar reads a region of a BGR image once and writes it bilinearly resized to
+   width x height as planar U8, replacing a crop, a cv::resize and a copy into the blob.
+   dst must hold 3 * width * height bytes, for example one batch slot of an NCHW input blob.*/
+void cropResizeToPlanar(const cv::Mat &src, const cv::Rect &roi, uint8_t *dst, int width, int height)
+{
+    const uint8_t *origin = src.ptr(roi.y) + roi.x * 3;
+    if (width == POSE_INPUT_WIDTH && height == POSE_INPUT_HEIGHT)
+        bilinearToPlanar<POSE_INPUT_WIDTH, POSE_INPUT_HEIGHT>(origin, src.step, roi.width, roi.height, dst, width, height);
+    else
+        bilinearToPlanar<0, 0>(origin, src.step, roi.width, roi.height, dst, width, height);
+}
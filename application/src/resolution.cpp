@@ -0,0 +1,97 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include "resolution.hpp"
+
+// parseResolution reads a resolution written as WIDTHxHEIGHT
+bool parseResolution(const std::string &text, cv::Size &size)
+{
+    int width, height;
+    char x;
+    if (sscanf(text.c_str(), "%d%c%d", &width, &x, &height) != 3 || (x != 'x' && x != 'X') || width <= 0 || height <= 0)
+        return false;
+    size = cv::Size(width, height);
+    return true;
+}
+
+ResolutionSelector::ResolutionSelector() : minFacePx(0), probeInterval(0), smallFace(0), selected(0)
+{
+}
+
+void ResolutionSelector::configure(const std::vector<cv::Size> &resolutions, int minFace, int probe)
+{
+    sizes = resolutions;
+    std::sort(sizes.begin(), sizes.end(), [](const cv::Size &a, const cv::Size &b) { return a.height < b.height; });
+    minFacePx = minFace;
+    probeInterval = std::max(1, probe);
+    smallFace = 0;
+    selected = sizes.empty() ? 0 : sizes.size() - 1;
+}
+
+bool ResolutionSelector::isEnabled() const
+{
+    return sizes.size() > 1;
+}
+
+// choose returns the index, in ascending height, of the resolution to run the frame at
+size_t ResolutionSelector::choose(uint64_t frame)
+{
+    size_t largest = sizes.size() - 1;
+    if (smallFace == 0 || frame % probeInterval == 0)
+        return largest;
+
+    // Moving to a smaller resolution needs a margin, so the choice does not flap between two
+    size_t best = largest;
+    for (size_t i = 0; i < largest; i++)
+    {
+        double margin = i < selected ? 1.25 : 1.0;
+        if (smallFace * sizes[i].height >= minFacePx * margin)
+        {
+            best = i;
+            break;
+        }
+    }
+    selected = best;
+    return best;
+}
+
+/* observe updates the small face estimate with the faces found in a frame run at resolution
+   chosen. Only frames run at the largest resolution see every face, so only they can raise the
+   estimate. A smaller face seen at any resolution lowers it at once.*/
+void ResolutionSelector::observe(const std::vector<cv::Rect> &faces, int frameHeight, size_t chosen)
+{
+    if (faces.empty() || frameHeight <= 0)
+        return;
+
+    int smallest = faces[0].height;
+    for (auto const &f : faces)
+        smallest = std::min(smallest, f.height);
+    double h = (double)smallest / frameHeight;
+
+    if (smallFace == 0 || h < smallFace)
+        smallFace = h;
+    else if (chosen == sizes.size() - 1)
+        smallFace = 0.7 * smallFace + 0.3 * h;
+}
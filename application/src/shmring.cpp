@@ -0,0 +1,330 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <iostream>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "shmring.hpp"
+
+const size_t pageBytes = 4096;
+const size_t slotHeaderBytes = 64;
+
+static size_t roundUp(size_t n, size_t to)
+{
+    return (n + to - 1) / to * to;
+}
+
+static size_t ringHeaderBytes()
+{
+    return roundUp(sizeof(ShmRingHeader), pageBytes);
+}
+
+static size_t frameBytes(uint32_t width, uint32_t height, uint32_t format)
+{
+    return format == SHM_FORMAT_NV12 ? (size_t)width * height * 3 / 2 : (size_t)width * height * 3;
+}
+
+static std::string shmName(const std::string &name)
+{
+    return name.empty() || name[0] == '/' ? name : "/" + name;
+}
+
+static int64_t monotonicMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static ShmSlotHeader *slotAt(ShmRingHeader *header, uint64_t seq)
+{
+    uint8_t *base = (uint8_t *)header + ringHeaderBytes();
+    return (ShmSlotHeader *)(base + (seq % header->slots) * header->slotBytes);
+}
+
+// The futex word is shared between processes, so the private futex operations cannot be used
+static void futexWait(std::atomic<uint32_t> *word, uint32_t expected, int timeoutMs)
+{
+    struct timespec ts;
+    ts.tv_sec = timeoutMs / 1000;
+    ts.tv_nsec = (long)(timeoutMs % 1000) * 1000000;
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAIT, expected, &ts, NULL, 0);
+}
+
+static void futexWake(std::atomic<uint32_t> *word)
+{
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+ShmRingWriter::ShmRingWriter() : header(NULL), mappedBytes(0), seq(0)
+{
+}
+
+ShmRingWriter::~ShmRingWriter()
+{
+    close();
+}
+
+// create replaces any ring of the same name with an empty one
+bool ShmRingWriter::create(const std::string &ringName, int width, int height, ShmFrameFormat format, int slots, double fps)
+{
+    close();
+    name = shmName(ringName);
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0660);
+    if (fd < 0)
+    {
+        std::cout << "Could not create shared memory " << name << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    size_t slotBytes = roundUp(slotHeaderBytes + frameBytes(width, height, format), pageBytes);
+    mappedBytes = ringHeaderBytes() + slotBytes * slots;
+    void *p = MAP_FAILED;
+    if (ftruncate(fd, mappedBytes) == 0)
+        p = mmap(NULL, mappedBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+    {
+        std::cout << "Could not map shared memory " << name << ": " << strerror(errno) << std::endl;
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    // The new object is zero filled, so only the layout needs writing. The magic goes last so a
+    // consumer never sees a partly written header.
+    header = (ShmRingHeader *)p;
+    header->version = SHM_RING_VERSION;
+    header->slots = slots;
+    header->slotBytes = slotBytes;
+    header->width = width;
+    header->height = height;
+    header->format = format;
+    header->fpsMilli = (uint32_t)(fps * 1000);
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = SHM_RING_MAGIC;
+    seq = 0;
+    return true;
+}
+
+/* publish copies one frame into the next slot and wakes the consumer. It returns false if the frame
+   was dropped because the consumer still holds that slot.*/
+bool ShmRingWriter::publish(const cv::Mat &frame, uint64_t timestampNs)
+{
+    uint64_t next = seq + 1;
+    int64_t heartbeat = header->consumerHeartbeat.load(std::memory_order_acquire);
+    bool attached = heartbeat != 0 && monotonicMs() - heartbeat < SHM_RING_STALE_MS;
+
+    // Frame next reuses the slot of frame next - slots, which must have been released
+    if (attached && next > header->released.load(std::memory_order_acquire) + header->slots)
+    {
+        header->dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    ShmSlotHeader *slot = slotAt(header, next);
+    uint8_t *data = (uint8_t *)slot + slotHeaderBytes;
+    size_t rowBytes = frame.cols * frame.elemSize();
+    if (rowBytes * frame.rows != frameBytes(header->width, header->height, header->format))
+    {
+        return false;
+    }
+    for (int r = 0; r < frame.rows; r++)
+    {
+        memcpy(data + r * rowBytes, frame.ptr(r), rowBytes);
+    }
+    slot->timestampNs = timestampNs;
+    slot->seq.store(next, std::memory_order_release);
+
+    seq = next;
+    header->head.store(next, std::memory_order_release);
+    header->wake.fetch_add(1, std::memory_order_release);
+    futexWake(&header->wake);
+    return true;
+}
+
+uint64_t ShmRingWriter::dropped() const
+{
+    return header ? header->dropped.load() : 0;
+}
+
+// close unmaps the ring and removes its name; consumers that still map it keep their mapping
+void ShmRingWriter::close()
+{
+    if (header)
+    {
+        munmap(header, mappedBytes);
+        shm_unlink(name.c_str());
+        header = NULL;
+    }
+}
+
+ShmFrameSource::ShmFrameSource() : header(NULL), mappedBytes(0), lastSeq(0), frameCount(0), skipCount(0)
+{
+}
+
+ShmFrameSource::~ShmFrameSource()
+{
+    close();
+}
+
+// open maps an existing ring and attaches to it as its consumer
+bool ShmFrameSource::open(const std::string &ringName)
+{
+    close();
+    std::string name = shmName(ringName);
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0)
+    {
+        std::cout << "Could not open shared memory " << name << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= ringHeaderBytes())
+        p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+    {
+        std::cout << "Could not map shared memory " << name << std::endl;
+        return false;
+    }
+
+    header = (ShmRingHeader *)p;
+    mappedBytes = st.st_size;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (header->magic != SHM_RING_MAGIC || header->version != SHM_RING_VERSION || header->slots == 0 ||
+        ringHeaderBytes() + (size_t)header->slots * header->slotBytes > mappedBytes ||
+        slotHeaderBytes + frameBytes(header->width, header->height, header->format) > header->slotBytes)
+    {
+        std::cout << "Shared memory " << name << " is not a frame ring" << std::endl;
+        close();
+        return false;
+    }
+
+    // Start from the newest frame, and tell the producer nothing is in use yet
+    lastSeq = header->head.load(std::memory_order_acquire);
+    header->released.store(lastSeq, std::memory_order_release);
+    header->consumerHeartbeat.store(monotonicMs(), std::memory_order_release);
+    frameCount = 0;
+    skipCount = 0;
+    return true;
+}
+
+bool ShmFrameSource::isOpen() const
+{
+    return header != NULL;
+}
+
+cv::Size ShmFrameSource::frameSize() const
+{
+    return cv::Size(header->width, header->height);
+}
+
+bool ShmFrameSource::isNV12() const
+{
+    return header->format == SHM_FORMAT_NV12;
+}
+
+double ShmFrameSource::fps() const
+{
+    return header->fpsMilli / 1000.0;
+}
+
+/* read waits up to timeoutMs for a frame newer than the last one read and maps the newest one into
+   frame without copying. Frames published in between are skipped. The frame stays valid until a
+   newer sequence number than seq is released.*/
+bool ShmFrameSource::read(cv::Mat &frame, uint64_t &seq, int timeoutMs)
+{
+    int64_t deadline = monotonicMs() + timeoutMs;
+    for (;;)
+    {
+        header->consumerHeartbeat.store(monotonicMs(), std::memory_order_release);
+        uint32_t wake = header->wake.load(std::memory_order_acquire);
+        uint64_t head = header->head.load(std::memory_order_acquire);
+        if (head > lastSeq)
+        {
+            ShmSlotHeader *slot = slotAt(header, head);
+            if (slot->seq.load(std::memory_order_acquire) != head)
+                continue;
+            skipCount += head - lastSeq - 1;
+            lastSeq = head;
+            frameCount++;
+
+            uint8_t *data = (uint8_t *)slot + slotHeaderBytes;
+            if (isNV12())
+                frame = cv::Mat(header->height * 3 / 2, header->width, CV_8UC1, data);
+            else
+                frame = cv::Mat(header->height, header->width, CV_8UC3, data);
+            seq = head;
+            return true;
+        }
+
+        // Wake at least every half second to keep the heartbeat fresh
+        int64_t left = deadline - monotonicMs();
+        if (left <= 0)
+            return false;
+        futexWait(&header->wake, wake, (int)std::min<int64_t>(left, SHM_RING_STALE_MS / 4));
+    }
+}
+
+// release tells the producer that every frame up to seq is no longer used
+void ShmFrameSource::release(uint64_t seq)
+{
+    if (seq > header->released.load(std::memory_order_relaxed))
+        header->released.store(seq, std::memory_order_release);
+}
+
+uint64_t ShmFrameSource::frames() const
+{
+    return frameCount;
+}
+
+uint64_t ShmFrameSource::skipped() const
+{
+    return skipCount;
+}
+
+uint64_t ShmFrameSource::dropped() const
+{
+    return header ? header->dropped.load() : 0;
+}
+
+// close detaches from the ring, so the producer stops keeping slots for this consumer
+void ShmFrameSource::close()
+{
+    if (header)
+    {
+        header->consumerHeartbeat.store(0, std::memory_order_release);
+        munmap(header, mappedBytes);
+        header = NULL;
+    }
+}
@@ -0,0 +1,221 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include "percentile.hpp"
+#include "shopstats.hpp"
+
+/* Durations go into log-scale histograms with two buckets per doubling from 100 ms, which gives
+   percentiles within 20% using a fixed amount of memory.*/
+const int durationBuckets = 48;
+const double firstBucketMs = 100;
+const int maxShards = 64;
+
+struct DurationHistogram
+{
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sumMs;
+    std::atomic<uint64_t> buckets[durationBuckets];
+};
+
+/* Each shard packs the window it belongs to and its highest shopper and looker counts in that
+   window into one word: 32 bits of window, 16 of shoppers and 16 of lookers. A stale window
+   number means the shard has not seen a frame since the window was closed.*/
+struct alignas(64) StatsShard
+{
+    std::atomic<uint64_t> windowMax;
+    std::atomic<uint64_t> visits;
+    std::atomic<uint64_t> converted;
+    DurationHistogram dwell;
+    DurationHistogram gaze;
+};
+
+static StatsShard shards[maxShards];
+static std::atomic<int> shardCount(0);
+static std::atomic<uint32_t> window(1);
+static std::mutex shardLock;
+static int shardUsers[maxShards];
+
+/* acquireStatsShard returns the shard of a new stream: a shard no stream uses, or the least used one
+   once maxShards streams run at the same time. Counters of a released shard are kept and added to.*/
+StatsShard *acquireStatsShard()
+{
+    std::lock_guard<std::mutex> guard(shardLock);
+    int count = shardCount.load();
+    int best = 0;
+    for (int s = 1; s < count; s++)
+    {
+        if (shardUsers[s] < shardUsers[best])
+            best = s;
+    }
+    if (count < maxShards && (count == 0 || shardUsers[best] > 0))
+    {
+        best = count;
+        shardCount.store(count + 1);
+    }
+    shardUsers[best]++;
+    return &shards[best];
+}
+
+// releaseStatsShard returns the shard of a stream that stopped.
+void releaseStatsShard(StatsShard *shard)
+{
+    std::lock_guard<std::mutex> guard(shardLock);
+    shardUsers[shard - shards]--;
+}
+
+static uint64_t packWindow(uint32_t w, int shoppers, int lookers)
+{
+    return ((uint64_t)w << 32) | ((uint64_t)std::min(shoppers, 0xffff) << 16) | (uint64_t)std::min(lookers, 0xffff);
+}
+
+/* recordShoppingInfo raises the shard's counts for the current window to those of a frame. If the
+   window was closed while the counts were stored, closeShoppingWindow may have merged the shard
+   before the store, so the counts are stored again in the new window. The store and the window
+   check are sequentially consistent with the window increment and merge of closeShoppingWindow,
+   so at least one of the two sees the other.*/
+void recordShoppingInfo(StatsShard *shard, const ShoppingInfo &info)
+{
+    uint32_t w = window.load();
+    uint64_t old = shard->windowMax.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        int shoppers = info.shoppers;
+        int lookers = info.lookers;
+        if ((uint32_t)(old >> 32) == w)
+        {
+            shoppers = std::max(shoppers, (int)((old >> 16) & 0xffff));
+            lookers = std::max(lookers, (int)(old & 0xffff));
+        }
+        uint64_t next = packWindow(w, shoppers, lookers);
+        if (next != old && !shard->windowMax.compare_exchange_weak(old, next))
+            continue;
+
+        uint32_t now = window.load();
+        if (now == w)
+            return;
+        w = now;
+        old = shard->windowMax.load(std::memory_order_relaxed);
+    }
+}
+
+static void addDuration(DurationHistogram &h, int64_t ms)
+{
+    ms = std::max<int64_t>(ms, 0);
+    int bucket = 0;
+    if (ms > firstBucketMs)
+        bucket = std::min(durationBuckets - 1, (int)(2 * std::log2(ms / firstBucketMs)));
+    h.count.fetch_add(1, std::memory_order_relaxed);
+    h.sumMs.fetch_add(ms, std::memory_order_relaxed);
+    h.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+// recordTrackEvents adds the dwell and gaze durations of finished visits and looks
+void recordTrackEvents(StatsShard *shard, const std::vector<TrackEvent> &events)
+{
+    for (auto const &e : events)
+    {
+        if (e.type == TrackEvent::Leave)
+        {
+            shard->visits.fetch_add(1, std::memory_order_relaxed);
+            if (e.converted)
+                shard->converted.fetch_add(1, std::memory_order_relaxed);
+            addDuration(shard->dwell, e.durationMs);
+        }
+        else if (e.type == TrackEvent::LookEnd)
+        {
+            addDuration(shard->gaze, e.durationMs);
+        }
+    }
+}
+
+static ShoppingInfo mergeWindow(uint32_t w)
+{
+    ShoppingInfo info = {0, 0};
+    int count = shardCount.load();
+    for (int s = 0; s < count; s++)
+    {
+        uint64_t v = shards[s].windowMax.load();
+        if ((uint32_t)(v >> 32) != w)
+            continue;
+        info.shoppers = std::max(info.shoppers, (int)((v >> 16) & 0xffff));
+        info.lookers = std::max(info.lookers, (int)(v & 0xffff));
+    }
+    return info;
+}
+
+// currentShoppingInfo returns the highest counts of any stream in the current window
+ShoppingInfo currentShoppingInfo()
+{
+    return mergeWindow(window.load());
+}
+
+// closeShoppingWindow starts a new window and returns the highest counts of the one it closed
+ShoppingInfo closeShoppingWindow()
+{
+    return mergeWindow(window.fetch_add(1));
+}
+
+static void mergeDurations(DurationHistogram StatsShard::*member, double &avg, double &p50, double &p90)
+{
+    std::vector<uint64_t> buckets(durationBuckets, 0);
+    uint64_t count = 0, sum = 0;
+    int shardsUsed = shardCount.load();
+    for (int s = 0; s < shardsUsed; s++)
+    {
+        DurationHistogram &h = shards[s].*member;
+        for (int b = 0; b < durationBuckets; b++)
+        {
+            uint64_t n = h.buckets[b].load(std::memory_order_relaxed);
+            buckets[b] += n;
+            count += n;
+        }
+        sum += h.sumMs.load(std::memory_order_relaxed);
+    }
+    avg = count ? (double)sum / count : 0;
+    p50 = histogramPercentile(buckets.data(), durationBuckets, 2, firstBucketMs, count, 0.5);
+    p90 = histogramPercentile(buckets.data(), durationBuckets, 2, firstBucketMs, count, 0.9);
+}
+
+// getVisitStats merges the visit statistics of all streams
+VisitStats getVisitStats()
+{
+    VisitStats stats;
+    stats.visits = 0;
+    stats.converted = 0;
+    stats.looks = 0;
+    int count = shardCount.load();
+    for (int s = 0; s < count; s++)
+    {
+        stats.visits += shards[s].visits.load(std::memory_order_relaxed);
+        stats.converted += shards[s].converted.load(std::memory_order_relaxed);
+        stats.looks += shards[s].gaze.count.load(std::memory_order_relaxed);
+    }
+    stats.conversion = stats.visits ? (double)stats.converted / stats.visits : 0;
+    mergeDurations(&StatsShard::dwell, stats.dwellAvgMs, stats.dwellP50Ms, stats.dwellP90Ms);
+    mergeDurations(&StatsShard::gaze, stats.gazeAvgMs, stats.gazeP50Ms, stats.gazeP90Ms);
+    return stats;
+}
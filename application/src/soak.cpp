@@ -0,0 +1,242 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <fstream>
+#include <iostream>
+#include <malloc.h>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "percentile.hpp"
+#include "soak.hpp"
+
+/* Stage latencies go into log-scale histograms with four buckets per doubling from 50 us, so
+   recording is one atomic increment. The sampler diffs the counts of consecutive samples to
+   get the percentiles of each interval.*/
+const int latencyBuckets = 80;
+const double firstLatencyMs = 0.05;
+
+std::atomic<bool> soakOn(false);
+
+static const char *stageNames[SoakStages] = {"capture", "queue", "face", "pose", "frame"};
+static std::atomic<uint64_t> latency[SoakStages][latencyBuckets];
+
+static SoakConfig soakConfig;
+static SoakQueueProbe soakProbe;
+static std::function<void()> soakFinish;
+static std::ofstream soakCsv;
+static std::thread soakThread;
+static std::mutex soakLock;
+static std::condition_variable soakWake;
+static bool soakStopping;
+static bool soakFailed;
+
+// MemorySample holds the process memory figures written to each CSV row, in KiB.
+struct MemorySample
+{
+    uint64_t rss;
+    uint64_t heapInUse;
+    uint64_t heapFree;
+    uint64_t mmapped;
+};
+
+SoakConfig defaultSoakConfig()
+{
+    SoakConfig config;
+    config.csvPath = "soak.csv";
+    config.interval = 60;
+    config.hours = 24;
+    config.warmup = 600;
+    config.maxRssGrowth = 20;
+    config.maxP99Growth = 50;
+    config.driftSamples = 3;
+    return config;
+}
+
+void soakAdd(SoakStage stage, double ms)
+{
+    int bucket = 0;
+    if (ms > firstLatencyMs)
+        bucket = std::min(latencyBuckets - 1, (int)(4 * std::log2(ms / firstLatencyMs)));
+    latency[stage][bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+static MemorySample sampleMemory()
+{
+    MemorySample m = {0, 0, 0, 0};
+    std::ifstream statm("/proc/self/statm");
+    uint64_t size, resident;
+    if (statm >> size >> resident)
+        m.rss = resident * (sysconf(_SC_PAGESIZE) / 1024);
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 mi = mallinfo2();
+    m.heapInUse = mi.uordblks / 1024;
+    m.heapFree = mi.fordblks / 1024;
+    m.mmapped = mi.hblkhd / 1024;
+#else
+    // mallinfo counts in int, so figures wrap past 2 GiB of heap
+    struct mallinfo mi = mallinfo();
+    m.heapInUse = (unsigned int)mi.uordblks / 1024;
+    m.heapFree = (unsigned int)mi.fordblks / 1024;
+    m.mmapped = (unsigned int)mi.hblkhd / 1024;
+#endif
+    return m;
+}
+
+static void soakRunner()
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<uint64_t> previous(SoakStages * latencyBuckets, 0);
+    uint64_t baseRss = 0, lastRss = 0;
+    double baseP99 = 0, lastP99 = 0;
+    int rssOver = 0, p99Over = 0;
+    std::string verdict;
+    double elapsed = 0;
+
+    // Samples are taken on a fixed schedule, so spurious wakeups do not add samples
+    std::chrono::steady_clock::time_point deadline = start;
+    std::unique_lock<std::mutex> guard(soakLock);
+    for (;;)
+    {
+        deadline += std::chrono::seconds(soakConfig.interval);
+        if (soakWake.wait_until(guard, deadline, []() { return soakStopping; }))
+            break;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        MemorySample mem = sampleMemory();
+        SoakQueues queues = soakProbe ? soakProbe() : SoakQueues();
+        soakCsv << (int64_t)elapsed << "," << mem.rss << "," << mem.heapInUse << "," << mem.heapFree << "," << mem.mmapped
+                << "," << queues.frames << "," << queues.outbox << "," << queues.telemetry;
+
+        double frameP99 = 0;
+        for (int s = 0; s < SoakStages; s++)
+        {
+            uint64_t counts[latencyBuckets];
+            uint64_t total = 0;
+            for (int b = 0; b < latencyBuckets; b++)
+            {
+                uint64_t now = latency[s][b].load(std::memory_order_relaxed);
+                counts[b] = now - previous[s * latencyBuckets + b];
+                previous[s * latencyBuckets + b] = now;
+                total += counts[b];
+            }
+            double p99 = histogramPercentile(counts, latencyBuckets, 4, firstLatencyMs, total, 0.99);
+            soakCsv << "," << total << "," << histogramPercentile(counts, latencyBuckets, 4, firstLatencyMs, total, 0.5) << "," << p99;
+            if (s == SoakFrame)
+                frameP99 = p99;
+        }
+        soakCsv << std::endl;
+        lastRss = mem.rss;
+        lastP99 = frameP99;
+
+        // The baseline is the first sample after warmup, once caches and pools have filled
+        if (baseRss == 0)
+        {
+            if (elapsed >= soakConfig.warmup && frameP99 > 0)
+            {
+                baseRss = mem.rss;
+                baseP99 = frameP99;
+            }
+        }
+        else
+        {
+            rssOver = mem.rss > baseRss * (1 + soakConfig.maxRssGrowth / 100) ? rssOver + 1 : 0;
+            p99Over = frameP99 > baseP99 * (1 + soakConfig.maxP99Growth / 100) ? p99Over + 1 : 0;
+            if (rssOver >= soakConfig.driftSamples)
+                verdict = "resident memory grew more than " + std::to_string((int)soakConfig.maxRssGrowth) + "%";
+            else if (p99Over >= soakConfig.driftSamples)
+                verdict = "frame p99 latency grew more than " + std::to_string((int)soakConfig.maxP99Growth) + "%";
+        }
+
+        if (!verdict.empty() || elapsed >= soakConfig.hours * 3600)
+            break;
+    }
+    guard.unlock();
+
+    // A run that ended before its hours were up, for example at the end of the input, did not pass
+    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (verdict.empty() && elapsed < soakConfig.hours * 3600)
+    {
+        std::ostringstream reason;
+        reason << "stopped before " << soakConfig.hours << " hours";
+        verdict = reason.str();
+    }
+    soakFailed = !verdict.empty();
+    std::string outcome = soakFailed ? "failed: " + verdict : "passed";
+    std::cout << "Soak run " << outcome << " after " << elapsed / 3600 << " hours. Resident memory " << baseRss << " -> "
+              << lastRss << " KiB, frame p99 " << baseP99 << " -> " << lastP99 << " ms" << std::endl;
+    if (soakFinish)
+        soakFinish();
+}
+
+/* soakStart starts sampling memory, queue depths and stage latencies into the CSV file. When the run
+   ends, because it lasted long enough or drifted too far, finish is called to stop the pipeline.*/
+bool soakStart(const SoakConfig &config, SoakQueueProbe probe, std::function<void()> finish)
+{
+    soakCsv.open(config.csvPath.c_str());
+    if (!soakCsv)
+    {
+        std::cout << "Could not open " << config.csvPath << std::endl;
+        return false;
+    }
+    soakCsv << "elapsed_s,rss_kb,heap_in_use_kb,heap_free_kb,mmap_kb,frame_queue,outbox_queue,telemetry_queue";
+    for (int s = 0; s < SoakStages; s++)
+        soakCsv << "," << stageNames[s] << "_count," << stageNames[s] << "_p50_ms," << stageNames[s] << "_p99_ms";
+    soakCsv << std::endl;
+
+    for (int s = 0; s < SoakStages; s++)
+        for (int b = 0; b < latencyBuckets; b++)
+            latency[s][b].store(0);
+    soakConfig = config;
+    soakConfig.interval = std::max(1, soakConfig.interval);
+    soakProbe = probe;
+    soakFinish = finish;
+    soakStopping = false;
+    soakFailed = false;
+    soakOn = true;
+    soakThread = std::thread(soakRunner);
+    return true;
+}
+
+// soakStop ends the run if it is still going and returns whether it passed
+bool soakStop()
+{
+    if (!soakThread.joinable())
+        return true;
+    {
+        std::lock_guard<std::mutex> guard(soakLock);
+        soakStopping = true;
+    }
+    soakWake.notify_all();
+    soakThread.join();
+    soakOn = false;
+    soakCsv.close();
+    return !soakFailed;
+}
@@ -0,0 +1,227 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <sstream>
+#include <vector>
+#include <zlib.h>
+#include "telemetry.hpp"
+
+static const uint8_t telemetryVersion = 1;
+static const uint8_t telemetryDeflate = 0x10;
+
+static const char *eventNames[] = {"frame", "enter", "leave", "look_start", "look_end"};
+
+// putVarint appends v as a little-endian base-128 varint.
+void putVarint(std::string &out, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        out.push_back((char)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((char)v);
+}
+
+static bool hasSecondField(TelemetryEvent::Type type)
+{
+    return type == TelemetryEvent::Frame || type == TelemetryEvent::Leave || type == TelemetryEvent::LookEnd;
+}
+
+TelemetryBatcher::TelemetryBatcher()
+{
+    format = TelemetryJSON;
+    compress = false;
+    maxBytes = 1024;
+    maxMs = 1000;
+    count = 0;
+    baseMs = 0;
+    lastMs = 0;
+    stats.events = 0;
+    stats.messages = 0;
+    stats.bytes = 0;
+    stats.queued = 0;
+    stats.seconds = 0;
+    running = false;
+}
+
+TelemetryBatcher::~TelemetryBatcher()
+{
+    stop();
+}
+
+// start configures the batch encoding and launches the flush thread.
+void TelemetryBatcher::start(TelemetryFormat fmt, bool deflate, size_t bytes, int ms, TelemetrySink s)
+{
+    if (running.load())
+    {
+        return;
+    }
+    format = fmt;
+    compress = deflate && fmt == TelemetryBinary;
+    maxBytes = bytes;
+    maxMs = ms;
+    sink = s;
+    started = std::chrono::steady_clock::now();
+    running = true;
+    flushThread = std::thread(&TelemetryBatcher::flushRunner, this);
+}
+
+// stop flushes the last batch and ends the flush thread.
+void TelemetryBatcher::stop()
+{
+    if (!running.exchange(false))
+    {
+        return;
+    }
+    full.notify_all();
+    flushThread.join();
+}
+
+bool TelemetryBatcher::isRunning() const
+{
+    return running.load();
+}
+
+// add appends one event to the current batch. Only the encoding of the event happens on the caller's thread.
+void TelemetryBatcher::add(const TelemetryEvent &event)
+{
+    if (!running.load())
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (count == 0)
+    {
+        baseMs = event.timeMs;
+        lastMs = event.timeMs;
+    }
+
+    if (format == TelemetryBinary)
+    {
+        // Events may come from different threads, so clamp rather than encode negative deltas
+        int64_t delta = event.timeMs > lastMs ? event.timeMs - lastMs : 0;
+        body.push_back((char)event.type);
+        putVarint(body, delta);
+        putVarint(body, event.a);
+        if (hasSecondField(event.type))
+            putVarint(body, event.b);
+        lastMs += delta;
+    }
+    else
+    {
+        std::ostringstream e;
+        e << (count ? "," : "") << "{\"type\": \"" << eventNames[event.type] << "\", \"t\": " << event.timeMs - baseMs;
+        if (event.type == TelemetryEvent::Frame)
+            e << ", \"shoppers\": " << event.a << ", \"lookers\": " << event.b;
+        else
+            e << ", \"track\": " << event.a;
+        if (event.type == TelemetryEvent::Leave)
+            e << ", \"dwell_ms\": " << event.b;
+        else if (event.type == TelemetryEvent::LookEnd)
+            e << ", \"duration_ms\": " << event.b;
+        e << "}";
+        body += e.str();
+    }
+    count++;
+
+    if (body.size() >= maxBytes)
+    {
+        sealed.push_back(seal());
+        full.notify_one();
+    }
+}
+
+// seal closes the current batch and returns its uncompressed encoding. Called with the lock held.
+std::string TelemetryBatcher::seal()
+{
+    std::string out;
+    if (format == TelemetryBinary)
+    {
+        out.push_back((char)telemetryVersion);
+        putVarint(out, baseMs);
+        putVarint(out, count);
+        out += body;
+    }
+    else
+    {
+        std::ostringstream header;
+        header << "{\"t0\": " << baseMs << ", \"count\": " << count << ", \"events\": [";
+        out = header.str() + body + "]}";
+    }
+    stats.events += count;
+    body.clear();
+    count = 0;
+    return out;
+}
+
+// flushRunner sends full batches as they are sealed and the current batch every maxMs.
+void TelemetryBatcher::flushRunner()
+{
+    bool last = false;
+    while (!last)
+    {
+        std::deque<std::string> messages;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            bool woken = full.wait_for(guard, std::chrono::milliseconds(maxMs), [this]() { return !sealed.empty() || !running.load(); });
+            last = !running.load();
+            if ((!woken || last) && count > 0)
+            {
+                sealed.push_back(seal());
+            }
+            messages.swap(sealed);
+        }
+
+        for (auto &message : messages)
+        {
+            if (compress)
+            {
+                uLongf size = compressBound(message.size() - 1);
+                std::vector<Bytef> packed(size);
+                if (compress2(packed.data(), &size, reinterpret_cast<const Bytef *>(message.data() + 1), message.size() - 1, Z_BEST_SPEED) == Z_OK &&
+                    size + 1 < message.size())
+                {
+                    std::string deflated(1, (char)(telemetryVersion | telemetryDeflate));
+                    deflated.append(reinterpret_cast<const char *>(packed.data()), size);
+                    message.swap(deflated);
+                }
+            }
+
+            sink(message);
+
+            std::lock_guard<std::mutex> guard(lock);
+            stats.messages++;
+            stats.bytes += message.size();
+        }
+    }
+}
+
+TelemetryStats TelemetryBatcher::getStats()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    TelemetryStats rtn = stats;
+    rtn.queued = sealed.size();
+    rtn.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return rtn;
+}
@@ -0,0 +1,205 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "trace.hpp"
+
+std::atomic<bool> traceOn(false);
+
+/* TraceRecord is one recorded event. name points to a string literal. The fields are published
+   under seq, which is odd while the owning thread writes the record and 2 * (n + 1) once it holds
+   event n, so traceDump can copy records that are still being written and discard torn copies.*/
+struct TraceRecord
+{
+    std::atomic<uint64_t> seq;
+    std::atomic<const char *> name;
+    std::atomic<uint64_t> timeNs;
+    std::atomic<uint64_t> frame;
+    std::atomic<uint64_t> arg;
+    std::atomic<char> phase;
+};
+
+// TraceBuffer is the event ring of one thread. Only the owning thread writes to it.
+struct TraceBuffer
+{
+    std::unique_ptr<TraceRecord[]> events;
+    size_t size;
+    std::atomic<uint64_t> count;
+    std::string name;
+    int tid;
+};
+
+static std::mutex traceLock;
+static std::vector<std::unique_ptr<TraceBuffer> > traceBuffers;
+static size_t traceCapacity = 0;
+static std::chrono::steady_clock::time_point traceEpoch;
+static thread_local TraceBuffer *threadBuffer = NULL;
+
+// traceStart enables tracing with a ring of the given number of events for every thread.
+void traceStart(size_t eventsPerThread)
+{
+    std::lock_guard<std::mutex> guard(traceLock);
+    traceCapacity = eventsPerThread > 0 ? eventsPerThread : 1;
+    traceEpoch = std::chrono::steady_clock::now();
+    traceOn = true;
+}
+
+static TraceBuffer *getThreadBuffer()
+{
+    if (threadBuffer == NULL)
+    {
+        std::lock_guard<std::mutex> guard(traceLock);
+        std::unique_ptr<TraceBuffer> b(new TraceBuffer);
+        b->events.reset(new TraceRecord[traceCapacity]);
+        b->size = traceCapacity;
+        for (size_t i = 0; i < b->size; i++)
+            b->events[i].seq.store(0, std::memory_order_relaxed);
+        b->count = 0;
+        b->tid = traceBuffers.size() + 1;
+        threadBuffer = b.get();
+        traceBuffers.push_back(std::move(b));
+    }
+    return threadBuffer;
+}
+
+// traceThreadName names the calling thread in the trace.
+void traceThreadName(const char *name)
+{
+    if (traceEnabled())
+    {
+        TraceBuffer *b = getThreadBuffer();
+        std::lock_guard<std::mutex> guard(traceLock);
+        b->name = name;
+    }
+}
+
+void traceEvent(char phase, const char *name, uint64_t frame, uint64_t arg)
+{
+    TraceBuffer *b = getThreadBuffer();
+    uint64_t n = b->count.load(std::memory_order_relaxed);
+    TraceRecord &r = b->events[n % b->size];
+    r.seq.store(2 * n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    r.name.store(name, std::memory_order_relaxed);
+    r.timeNs.store(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - traceEpoch).count(), std::memory_order_relaxed);
+    r.frame.store(frame, std::memory_order_relaxed);
+    r.arg.store(arg, std::memory_order_relaxed);
+    r.phase.store(phase, std::memory_order_relaxed);
+    r.seq.store(2 * n + 2, std::memory_order_release);
+    b->count.store(n + 1, std::memory_order_release);
+}
+
+// readRecord copies event i of a ring and returns false if it was overwritten or is being written.
+static bool readRecord(const TraceBuffer &b, uint64_t i, const char *&name, uint64_t &timeNs, uint64_t &frame, uint64_t &arg, char &phase)
+{
+    const TraceRecord &r = b.events[i % b.size];
+    uint64_t seq = r.seq.load(std::memory_order_acquire);
+    if (seq != 2 * i + 2)
+    {
+        return false;
+    }
+    name = r.name.load(std::memory_order_relaxed);
+    timeNs = r.timeNs.load(std::memory_order_relaxed);
+    frame = r.frame.load(std::memory_order_relaxed);
+    arg = r.arg.load(std::memory_order_relaxed);
+    phase = r.phase.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return r.seq.load(std::memory_order_relaxed) == seq;
+}
+
+// TraceCopy is an event copied out of a ring, so the file can be written without holding traceLock.
+struct TraceCopy
+{
+    const char *name;
+    uint64_t timeNs;
+    uint64_t frame;
+    uint64_t arg;
+    char phase;
+    int tid;
+};
+
+/* traceDump writes the recorded events as Chrome trace-event JSON, which opens in Perfetto and
+   chrome://tracing. It may run while other threads keep recording, so events overwritten or being
+   written during the copy are skipped. Only the copy holds traceLock; the file is written after it,
+   so threads starting to trace are not held up by the disk.*/
+bool traceDump(const std::string &path)
+{
+    std::vector<std::pair<int, std::string> > names;
+    std::vector<TraceCopy> events;
+    {
+        std::lock_guard<std::mutex> guard(traceLock);
+        for (auto const &b : traceBuffers)
+        {
+            if (!b->name.empty())
+                names.push_back(std::make_pair(b->tid, b->name));
+
+            uint64_t n = b->count.load(std::memory_order_acquire);
+            uint64_t start = n > b->size ? n - b->size : 0;
+            for (uint64_t i = start; i < n; i++)
+            {
+                TraceCopy e;
+                e.tid = b->tid;
+                if (readRecord(*b, i, e.name, e.timeNs, e.frame, e.arg, e.phase))
+                    events.push_back(e);
+            }
+        }
+    }
+
+    std::ofstream out(path.c_str());
+    if (!out)
+    {
+        return false;
+    }
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    bool first = true;
+    for (auto const &n : names)
+    {
+        out << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << n.first
+            << ", \"args\": {\"name\": \"" << n.second << "\"}}";
+        first = false;
+    }
+    char ts[32];
+    for (auto const &e : events)
+    {
+        snprintf(ts, sizeof(ts), "%.3f", e.timeNs / 1000.0);
+        out << (first ? "" : ",\n") << "{\"name\": \"" << e.name << "\", \"cat\": \"pipeline\", \"ph\": \"" << e.phase
+            << "\", \"ts\": " << ts << ", \"pid\": 1, \"tid\": " << e.tid;
+        if (e.phase == 'b' || e.phase == 'e')
+            out << ", \"id\": " << e.frame;
+        else if (e.phase == 'i')
+            out << ", \"s\": \"t\"";
+        out << ", \"args\": {\"frame\": " << e.frame;
+        if (e.phase == 'B' || e.phase == 'E')
+            out << ", \"index\": " << e.arg;
+        out << "}}";
+        first = false;
+    }
+    out << "\n]}\n";
+    return out.good();
+}
@@ -0,0 +1,232 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include "tracker.hpp"
+
+FaceTracker::FaceTracker(float iou, int missed)
+{
+    minIou = iou;
+    maxMissed = missed;
+    nextId = 1;
+    gaze = defaultGazeFilter();
+}
+
+// The shopper is looking if their head is tilted within a 45 degree angle relative to the shelf
+static const float plainLookingDeg = 22.5f;
+
+GazeFilter defaultGazeFilter()
+{
+    GazeFilter filter;
+    filter.enabled = false;
+    filter.alpha = 1;
+    filter.enterDeg = plainLookingDeg;
+    filter.exitDeg = plainLookingDeg;
+    filter.marginDeg = 0;
+    filter.maxSkip = 0;
+    return filter;
+}
+
+static float iou(const cv::Rect &a, const cv::Rect &b)
+{
+    int inter = (a & b).area();
+    int uni = a.area() + b.area() - inter;
+    return uni > 0 ? (float)inter / uni : 0;
+}
+
+/* update matches the detections of a new frame to the current tracks and returns, for every
+   detection, the index of its track in tracks. Unmatched detections start new tracks.*/
+std::vector<int> FaceTracker::update(const std::vector<cv::Rect> &faces, int64_t nowMs, std::vector<TrackEvent> &events)
+{
+    // Collect candidate pairs and match the best overlaps first
+    std::vector<std::pair<float, std::pair<int, int> > > pairs;
+    for (size_t t = 0; t < tracks.size(); t++)
+    {
+        for (size_t f = 0; f < faces.size(); f++)
+        {
+            float o = iou(tracks[t].rect, faces[f]);
+            if (o >= minIou)
+            {
+                pairs.push_back(std::make_pair(o, std::make_pair((int)t, (int)f)));
+            }
+        }
+    }
+    std::sort(pairs.begin(), pairs.end(), [](const std::pair<float, std::pair<int, int> > &a, const std::pair<float, std::pair<int, int> > &b) {
+        return a.first > b.first;
+    });
+
+    std::vector<int> assigned(faces.size(), -1);
+    std::vector<bool> matched(tracks.size(), false);
+    for (auto const &p : pairs)
+    {
+        int t = p.second.first;
+        int f = p.second.second;
+        if (!matched[t] && assigned[f] < 0)
+        {
+            matched[t] = true;
+            assigned[f] = t;
+            tracks[t].rect = faces[f];
+            tracks[t].lastSeenMs = nowMs;
+            tracks[t].missed = 0;
+        }
+    }
+
+    // Age out tracks that were not seen, keeping the indexes of the matched ones up to date
+    std::vector<int> remap(tracks.size(), -1);
+    size_t kept = 0;
+    for (size_t t = 0; t < tracks.size(); t++)
+    {
+        if (!matched[t] && ++tracks[t].missed > maxMissed)
+        {
+            if (tracks[t].looking)
+            {
+                TrackEvent e = {TrackEvent::LookEnd, tracks[t].id, tracks[t].lastSeenMs, tracks[t].lastSeenMs - tracks[t].lookStartMs, false};
+                events.push_back(e);
+            }
+            TrackEvent e = {TrackEvent::Leave, tracks[t].id, tracks[t].lastSeenMs, tracks[t].lastSeenMs - tracks[t].firstSeenMs, tracks[t].converted};
+            events.push_back(e);
+            continue;
+        }
+        remap[t] = kept;
+        tracks[kept++] = tracks[t];
+    }
+    tracks.resize(kept);
+    for (auto &a : assigned)
+    {
+        if (a >= 0)
+            a = remap[a];
+    }
+
+    for (size_t f = 0; f < faces.size(); f++)
+    {
+        if (assigned[f] >= 0)
+            continue;
+        Track track;
+        track.id = nextId++;
+        track.rect = faces[f];
+        track.firstSeenMs = nowMs;
+        track.lastSeenMs = nowMs;
+        track.lookStartMs = 0;
+        track.poseMs = 0;
+        track.yaw = 0;
+        track.pitch = 0;
+        track.poses = 0;
+        track.poseAge = 0;
+        track.missed = 0;
+        track.looking = false;
+        track.converted = false;
+        tracks.push_back(track);
+        assigned[f] = tracks.size() - 1;
+
+        TrackEvent e = {TrackEvent::Enter, track.id, nowMs, 0, false};
+        events.push_back(e);
+    }
+
+    return assigned;
+}
+
+// setLooking records the gaze decision for a track and reports look start and end transitions.
+void FaceTracker::setLooking(int trackIndex, bool looking, int64_t nowMs, std::vector<TrackEvent> &events)
+{
+    Track &track = tracks[trackIndex];
+    track.poseMs = nowMs;
+    if (looking == track.looking)
+    {
+        return;
+    }
+
+    track.looking = looking;
+    if (looking)
+    {
+        track.lookStartMs = nowMs;
+        track.converted = true;
+        TrackEvent e = {TrackEvent::LookStart, track.id, nowMs, 0, false};
+        events.push_back(e);
+    }
+    else
+    {
+        TrackEvent e = {TrackEvent::LookEnd, track.id, nowMs, nowMs - track.lookStartMs, false};
+        events.push_back(e);
+    }
+}
+
+// setGazeFilter replaces the smoothing and hysteresis settings used by updatePose and needsPose.
+void FaceTracker::setGazeFilter(const GazeFilter &filter)
+{
+    gaze = filter;
+}
+
+// offAxis returns how far a head pose is from facing the shelf, the larger of its yaw and pitch.
+static float offAxis(const Track &track)
+{
+    return std::max(std::fabs(track.yaw), std::fabs(track.pitch));
+}
+
+/* needsPose reports whether a track needs head pose inference in this frame. A confident track,
+   one whose smoothed pose is well clear of the threshold that would flip its looking state, keeps
+   its state for up to maxSkip frames; every skipped frame is counted against that allowance.*/
+bool FaceTracker::needsPose(int trackIndex)
+{
+    Track &track = tracks[trackIndex];
+    if (!gaze.enabled || track.poses < 2 || track.poseAge >= gaze.maxSkip)
+    {
+        return true;
+    }
+
+    float margin = track.looking ? gaze.exitDeg - offAxis(track) : offAxis(track) - gaze.enterDeg;
+    if (margin < gaze.marginDeg)
+    {
+        return true;
+    }
+    track.poseAge++;
+    return false;
+}
+
+/* updatePose folds a head pose result into the track's smoothed pose, applies the looking test,
+   with hysteresis when the filter is enabled, and returns the resulting looking state.*/
+bool FaceTracker::updatePose(int trackIndex, float yaw, float pitch, int64_t nowMs, std::vector<TrackEvent> &events)
+{
+    Track &track = tracks[trackIndex];
+    if (track.poses == 0 || !gaze.enabled)
+    {
+        track.yaw = yaw;
+        track.pitch = pitch;
+    }
+    else
+    {
+        track.yaw += gaze.alpha * (yaw - track.yaw);
+        track.pitch += gaze.alpha * (pitch - track.pitch);
+    }
+    track.poses++;
+    track.poseAge = 0;
+
+    // A disabled filter keeps the plain looking test, whatever angles it was configured with
+    bool looking;
+    if (!gaze.enabled)
+        looking = offAxis(track) < plainLookingDeg;
+    else
+        looking = track.looking ? offAxis(track) < gaze.exitDeg : offAxis(track) < gaze.enterDeg;
+    setLooking(trackIndex, looking, nowMs, events);
+    return looking;
+}
@@ -23,6 +23,7 @@
 sudo apt-get update
 sudo apt-get install mosquitto mosquitto-clients    # install mosquitto
 sudo apt-get install libssl-dev
+sudo apt-get install zlib1g-dev
 
 if [ -d "json" ]
 then
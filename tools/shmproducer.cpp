@@ -0,0 +1,148 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* shmproducer decodes a video file or camera and publishes its frames into a shared-memory frame
+   ring, standing in for an NVR process feeding the monitor. Run it before starting the monitor
+   with "video": "shm:<name>" in its config file.*/
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <opencv2/opencv.hpp>
+#include "shmring.hpp"
+
+using namespace std;
+using namespace cv;
+
+std::atomic<bool> keepRunning(true);
+
+const cv::String keys =
+    "{ help  h     | | Print help message. }"
+    "{ input i     | | Path to input video file, or camera index.}"
+    "{ name n      | sgm0 | name of the shared memory frame ring. }"
+    "{ slots s     | 8 | number of frames the ring holds. }"
+    "{ nv12        | | publish NV12 frames instead of BGR. }"
+    "{ loop l      | | restart the video file when it ends. }";
+
+void handleSignal(int)
+{
+    keepRunning = false;
+}
+
+// toNV12 converts a BGR frame into one NV12 buffer: the Y plane followed by interleaved U and V
+void toNV12(const Mat &bgr, Mat &i420, Mat &nv12)
+{
+    cvtColor(bgr, i420, COLOR_BGR2YUV_I420);
+    int w = bgr.cols, h = bgr.rows;
+    nv12.create(h * 3 / 2, w, CV_8UC1);
+    memcpy(nv12.data, i420.data, (size_t)w * h);
+    const uchar *u = i420.data + (size_t)w * h;
+    const uchar *v = u + (size_t)w * h / 4;
+    uchar *uv = nv12.data + (size_t)w * h;
+    for (size_t i = 0; i < (size_t)w * h / 4; i++)
+    {
+        uv[2 * i] = u[i];
+        uv[2 * i + 1] = v[i];
+    }
+}
+
+int main(int argc, char **argv)
+{
+    CommandLineParser parser(argc, argv, keys);
+    parser.about("Publish decoded frames into a shared memory frame ring.");
+    if (argc == 1 || parser.has("help") || !parser.has("input"))
+    {
+        parser.printMessage();
+        return 0;
+    }
+
+    string input = parser.get<cv::String>("input");
+    VideoCapture cap;
+    bool camera = input.size() == 1 && input[0] >= '0' && input[0] <= '9';
+    if (camera)
+        cap.open(std::stoi(input));
+    else
+        cap.open(input);
+    Mat frame;
+    if (!cap.isOpened() || !cap.read(frame))
+    {
+        cerr << "ERROR! Unable to open video source\n";
+        return -1;
+    }
+    double fps = cap.get(CAP_PROP_FPS);
+    if (fps <= 0)
+        fps = 30;
+
+    bool nv12 = parser.has("nv12");
+    ShmRingWriter ring;
+    if (!ring.create(parser.get<cv::String>("name"), frame.cols, frame.rows, nv12 ? SHM_FORMAT_NV12 : SHM_FORMAT_BGR,
+                     std::max(2, parser.get<int>("slots")), fps))
+    {
+        return -1;
+    }
+    cout << "Publishing " << frame.cols << "x" << frame.rows << (nv12 ? " NV12" : " BGR") << " frames at " << fps
+         << " fps to " << parser.get<cv::String>("name") << endl;
+
+    signal(SIGINT, handleSignal);
+    signal(SIGTERM, handleSignal);
+    Mat i420, converted;
+    uint64_t published = 0;
+    std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point lastReport = next;
+    while (keepRunning.load())
+    {
+        uint64_t timestampNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        if (nv12)
+            toNV12(frame, i420, converted);
+        if (ring.publish(nv12 ? converted : frame, timestampNs))
+            published++;
+
+        if (std::chrono::steady_clock::now() - lastReport >= std::chrono::seconds(5))
+        {
+            cout << "Published " << published << " frames, dropped " << ring.dropped() << endl;
+            lastReport = std::chrono::steady_clock::now();
+        }
+
+        // Pace file playback at the clip frame rate; cameras pace themselves
+        if (!camera)
+        {
+            next += std::chrono::microseconds((int64_t)(1e6 / fps));
+            std::this_thread::sleep_until(next);
+        }
+        if (!cap.read(frame))
+        {
+            if (!parser.has("loop") || camera)
+                break;
+            cap.set(CAP_PROP_POS_FRAMES, 0);
+            if (!cap.read(frame))
+                break;
+        }
+    }
+
+    cout << "Published " << published << " frames, dropped " << ring.dropped() << endl;
+    ring.close();
+    return 0;
+}